@@ -1,18 +1,122 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/functional.h>
 
 #include "definition_extractor.hpp"
+#include "definition_sweeper.hpp"
 
 namespace py = pybind11;
 
 using namespace definability_interpolation;
 
+// Allows orderings to be implemented in Python.
+class py_variable_ordering : public variable_ordering {
+ public:
+    std::string name() const override {
+        PYBIND11_OVERRIDE_PURE(std::string, variable_ordering, name);
+    }
+    std::vector<size_t> order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const override {
+        PYBIND11_OVERRIDE_PURE(std::vector<size_t>, variable_ordering, order, variables, is_existential, clauses);
+    }
+};
+
 PYBIND11_MODULE(definition_extractor_module, m) {
+    py::enum_<InterpolationSystem>(m, "InterpolationSystem")
+        .value("PUDLAK", InterpolationSystem::PUDLAK)
+        .value("MCMILLAN", InterpolationSystem::MCMILLAN)
+        .value("MCMILLAN_DUAL", InterpolationSystem::MCMILLAN_DUAL)
+        .value("SMALLEST", InterpolationSystem::SMALLEST);
+
+    // Formulas convert implicitly from lists of clauses; clauses are returned as lists.
+    py::class_<cnf>(m, "cnf")
+        .def(py::init<>())
+        .def(py::init<const std::vector<std::vector<int>>&>())
+        .def("add_clause", [](cnf& formula, const std::vector<int>& clause) { formula.add_clause(clause); })
+        .def("__len__", &cnf::size)
+        .def("__getitem__", [](const cnf& formula, size_t i) {
+            if (i >= formula.size()) {
+                throw py::index_error();
+            }
+            auto clause = formula[i];
+            return std::vector<int>(clause.begin(), clause.end());
+        })
+        .def("__iter__", [](const cnf& formula) { return py::iter(py::cast(formula.to_vectors())); })
+        .def("num_literals", &cnf::num_literals)
+        .def("to_list", &cnf::to_vectors);
+    py::implicitly_convertible<std::vector<std::vector<int>>, cnf>();
+
     py::class_<definition_extractor>(m, "definition_extractor")
         .def(py::init<>())  // Default constructor
-        .def("add_clause", &definition_extractor::add_clause)
-        .def("append_formula", &definition_extractor::append_formula)
+        .def("add_clause", [](definition_extractor& extractor, const std::vector<int>& clause) { extractor.add_clause(clause); })
+        .def("append_formula", &definition_extractor::append_formula, py::arg("formula"), py::arg("num_variables") = 0)
         .def("has_definition", &definition_extractor::has_definition)
-        .def("get_definition", &definition_extractor::get_definition);
-}
+        .def("get_definition", &definition_extractor::get_definition, py::arg("rewrite"), py::arg("system") = InterpolationSystem::PUDLAK, py::arg("compact_encoding") = false)
+        .def("queue_definition", &definition_extractor::queue_definition, py::arg("rewrite"), py::arg("system") = InterpolationSystem::PUDLAK, py::arg("compact_encoding") = false)
+        .def("next_definition", &definition_extractor::next_definition)
+        .def("queued_definitions", &definition_extractor::queued_definitions)
+        .def("solver_calls", &definition_extractor::solver_calls)
+        .def("set_cache", &definition_extractor::set_cache, py::arg("enabled"), py::arg("keep_definitions") = false)
+        .def("set_proofnode_threads", &definition_extractor::set_proofnode_threads);
+
+    py::enum_<SweepMode>(m, "SweepMode")
+        .value("FORWARD", SweepMode::FORWARD)
+        .value("FORWARD_STRICT", SweepMode::FORWARD_STRICT)
+        .value("TRANSITIVE", SweepMode::TRANSITIVE);
 
+    py::class_<variable_ordering, py_variable_ordering>(m, "variable_ordering")
+        .def(py::init<>())
+        .def("name", &variable_ordering::name)
+        .def("order", &variable_ordering::order);
+    py::class_<prefix_ordering, variable_ordering>(m, "prefix_ordering")
+        .def(py::init<bool>(), py::arg("reversed") = false);
+    py::class_<occurrence_ordering, variable_ordering>(m, "occurrence_ordering")
+        .def(py::init<>());
+    py::class_<dependency_ordering, variable_ordering>(m, "dependency_ordering")
+        .def(py::init<>());
+
+    py::class_<sweep_statistics>(m, "sweep_statistics")
+        .def_readonly("strategy", &sweep_statistics::strategy)
+        .def_readonly("nr_existential", &sweep_statistics::nr_existential)
+        .def_readonly("nr_defined", &sweep_statistics::nr_defined)
+        .def_readonly("nr_shared", &sweep_statistics::nr_shared)
+        .def_readonly("total_definition_clauses", &sweep_statistics::total_definition_clauses)
+        .def_readonly("sat_calls", &sweep_statistics::sat_calls)
+        .def_readonly("sat_seconds", &sweep_statistics::sat_seconds)
+        .def_readonly("interpolation_seconds", &sweep_statistics::interpolation_seconds)
+        .def_readonly("total_seconds", &sweep_statistics::total_seconds)
+        .def_readonly("stopped", &sweep_statistics::stopped);
+
+    py::class_<check_event>(m, "check_event")
+        .def_readonly("variable", &check_event::variable)
+        .def_readonly("defined", &check_event::defined)
+        .def_readonly("shared", &check_event::shared)
+        .def_readonly("sat_seconds", &check_event::sat_seconds)
+        .def_readonly("interpolation_seconds", &check_event::interpolation_seconds)
+        .def_readonly("definition_clauses", &check_event::definition_clauses);
+
+    // Definitions are collected by sweep itself; stopping flags and pools are only used by the CLI portfolio.
+    py::class_<sweep_options>(m, "sweep_options")
+        .def(py::init<>())
+        .def_readwrite("rewrite", &sweep_options::rewrite)
+        .def_readwrite("system", &sweep_options::system)
+        .def_readwrite("compact_encoding", &sweep_options::compact_encoding)
+        .def_readwrite("eligible", &sweep_options::eligible)
+        .def_readwrite("on_progress", &sweep_options::on_progress)
+        .def_readwrite("on_check", &sweep_options::on_check)
+        .def_readwrite("target", &sweep_options::target)
+        .def_readwrite("pipeline_depth", &sweep_options::pipeline_depth);
+
+    // The sweeper only references the formula, so it is constructed and run in one call.
+    // Returns the statistics and a list of (variable, definition clauses, first auxiliary variable).
+    m.def("sweep", [](definition_extractor& extractor, int num_variables, const std::vector<int>& variables, const std::vector<bool>& is_existential,
+                      const cnf& clauses, const variable_ordering& ordering, SweepMode mode, sweep_options options) {
+        std::vector<std::tuple<int, cnf, int>> definitions;
+        options.on_definition = [&definitions](int variable, cnf& definition_clauses, int auxiliary_start) {
+            definitions.emplace_back(variable, std::move(definition_clauses), auxiliary_start);
+        };
+        definition_sweeper sweeper(extractor, num_variables, variables, is_existential, clauses);
+        auto statistics = sweeper.run(ordering, mode, options);
+        return std::make_pair(statistics, definitions);
+    }, py::arg("extractor"), py::arg("num_variables"), py::arg("variables"), py::arg("is_existential"), py::arg("clauses"),
+       py::arg("ordering"), py::arg("mode") = SweepMode::TRANSITIVE, py::arg("options") = sweep_options());
+}
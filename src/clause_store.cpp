@@ -0,0 +1,132 @@
+#include "clause_store.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace definability_interpolation {
+
+clause_store::clause_store() : current_chunk(std::numeric_limits<uint32_t>::max()) {}
+
+uint8_t* clause_store::allocate(uint32_t length, handle& h) {
+  auto new_chunk = [this](uint32_t capacity) {
+    uint32_t index;
+    if (!free_chunks.empty()) {
+      index = free_chunks.back();
+      free_chunks.pop_back();
+    } else {
+      index = chunks.size();
+      chunks.emplace_back();
+    }
+    auto& c = chunks[index];
+    c.data = std::make_unique<uint8_t[]>(capacity);
+    c.capacity = capacity;
+    c.used = 0;
+    c.live = 0;
+    return index;
+  };
+  uint32_t index;
+  if (length > chunk_size) {
+    // Oversized clauses get a chunk of their own.
+    index = new_chunk(length);
+  } else {
+    if (current_chunk == std::numeric_limits<uint32_t>::max() || chunks[current_chunk].used + length > chunks[current_chunk].capacity) {
+      // Retire the current chunk, releasing it right away if nothing in it is alive anymore.
+      if (current_chunk != std::numeric_limits<uint32_t>::max() && chunks[current_chunk].live == 0) {
+        chunks[current_chunk].data.reset();
+        free_chunks.push_back(current_chunk);
+      }
+      current_chunk = new_chunk(chunk_size);
+    }
+    index = current_chunk;
+  }
+  auto& c = chunks[index];
+  h = {index, c.used, length};
+  c.used += length;
+  c.live += length;
+  return c.data.get() + h.offset;
+}
+
+void clause_store::insert(int64_t id, const std::vector<int>& clause) {
+  if (id_to_handle.contains(id)) {
+    erase(id);
+  }
+  code_buffer.clear();
+  for (auto l: clause) {
+    code_buffer.push_back((static_cast<uint32_t>(std::abs(l)) << 1) | (l < 0));
+  }
+  std::sort(code_buffer.begin(), code_buffer.end());
+  byte_buffer.clear();
+  uint32_t previous = 0;
+  for (auto code: code_buffer) {
+    auto delta = code - previous;
+    previous = code;
+    while (delta >= 0x80) {
+      byte_buffer.push_back(static_cast<uint8_t>(delta | 0x80));
+      delta >>= 7;
+    }
+    byte_buffer.push_back(static_cast<uint8_t>(delta));
+  }
+  // The empty clause does not occupy any chunk.
+  handle h = {std::numeric_limits<uint32_t>::max(), 0, 0};
+  if (!byte_buffer.empty()) {
+    auto destination = allocate(byte_buffer.size(), h);
+    std::memcpy(destination, byte_buffer.data(), byte_buffer.size());
+  }
+  id_to_handle.emplace(id, h);
+}
+
+void clause_store::erase(int64_t id) {
+  auto it = id_to_handle.find(id);
+  if (it == id_to_handle.end()) {
+    return;
+  }
+  auto h = it->second;
+  id_to_handle.erase(it);
+  if (h.length == 0) {
+    return;
+  }
+  auto& c = chunks[h.chunk];
+  assert(c.live >= h.length);
+  c.live -= h.length;
+  if (c.live == 0 && h.chunk != current_chunk) {
+    // Every clause in this chunk is gone, so the memory can be handed back.
+    c.data.reset();
+    c.capacity = 0;
+    c.used = 0;
+    free_chunks.push_back(h.chunk);
+  }
+}
+
+clause_store::decoder clause_store::decode(int64_t id) const {
+  const auto& h = id_to_handle.at(id);
+  if (h.length == 0) {
+    return decoder(nullptr, nullptr);
+  }
+  auto begin = chunks[h.chunk].data.get() + h.offset;
+  return decoder(begin, begin + h.length);
+}
+
+std::vector<int> clause_store::get(int64_t id) const {
+  std::vector<int> clause;
+  auto d = decode(id);
+  int literal;
+  while (d.next(literal)) {
+    clause.push_back(literal);
+  }
+  return clause;
+}
+
+size_t clause_store::allocated_bytes() const {
+  size_t bytes = 0;
+  for (const auto& c: chunks) {
+    if (c.data) {
+      bytes += c.capacity;
+    }
+  }
+  return bytes;
+}
+
+} // namespace definability_interpolation
@@ -0,0 +1,84 @@
+#ifndef CLAUSE_STORE_HPP
+#define CLAUSE_STORE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace definability_interpolation {
+
+// Compact storage for traced clause bodies.
+// Literals are mapped to unsigned codes (2 * variable + sign), sorted, and stored as varint-encoded deltas
+// in fixed-size chunks. Clauses are only ever read sequentially, so they are accessed through a streaming decoder.
+class clause_store {
+ public:
+  class decoder {
+   public:
+    decoder(const uint8_t* begin, const uint8_t* end) : position(begin), end(end), previous(0) {}
+    // Decode the next literal, returns false once the clause is exhausted.
+    bool next(int& literal) {
+      if (position == end) {
+        return false;
+      }
+      uint32_t delta = 0;
+      int shift = 0;
+      uint8_t byte;
+      do {
+        byte = *position++;
+        delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      previous += delta;
+      auto variable = static_cast<int>(previous >> 1);
+      literal = (previous & 1) ? -variable : variable;
+      return true;
+    }
+
+   private:
+    const uint8_t* position;
+    const uint8_t* end;
+    uint32_t previous;
+  };
+
+  clause_store();
+
+  void insert(int64_t id, const std::vector<int>& clause);
+  void erase(int64_t id);
+  bool contains(int64_t id) const { return id_to_handle.contains(id); }
+  decoder decode(int64_t id) const;
+  std::vector<int> get(int64_t id) const;
+  size_t size() const { return id_to_handle.size(); }
+  // Number of bytes currently held by chunks (live and dead data).
+  size_t allocated_bytes() const;
+
+ private:
+  static constexpr uint32_t chunk_size = 1 << 20;
+
+  struct handle {
+    uint32_t chunk;
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  struct chunk {
+    std::unique_ptr<uint8_t[]> data;
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t live;
+  };
+
+  uint8_t* allocate(uint32_t length, handle& h);
+
+  std::unordered_map<int64_t, handle> id_to_handle;
+  std::vector<chunk> chunks;
+  std::vector<uint32_t> free_chunks;
+  uint32_t current_chunk;
+
+  std::vector<uint32_t> code_buffer;
+  std::vector<uint8_t> byte_buffer;
+};
+
+} // namespace definability_interpolation
+
+#endif // CLAUSE_STORE_HPP
@@ -0,0 +1,131 @@
+#ifndef CNF_HPP
+#define CNF_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <span>
+#include <vector>
+
+namespace definability_interpolation {
+
+// Clauses stored back to back in a single literal buffer, with offsets marking where each clause starts.
+// Clauses are accessed as spans, so adding, reading and renaming them does not allocate per clause.
+class cnf {
+ public:
+  template <typename Literal>
+  class basic_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::span<Literal>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = std::span<Literal>;
+
+    basic_iterator() : literals(nullptr), offset(nullptr) {}
+    basic_iterator(Literal* literals, const size_t* offset) : literals(literals), offset(offset) {}
+    std::span<Literal> operator*() const { return std::span<Literal>(literals + offset[0], literals + offset[1]); }
+    basic_iterator& operator++() { offset++; return *this; }
+    basic_iterator operator++(int) { auto previous = *this; offset++; return previous; }
+    bool operator==(const basic_iterator& other) const { return offset == other.offset; }
+
+   private:
+    Literal* literals;
+    const size_t* offset;
+  };
+  using iterator = basic_iterator<int>;
+  using const_iterator = basic_iterator<const int>;
+
+  cnf() : offsets{0} {}
+  explicit cnf(const std::vector<std::vector<int>>& clauses) : cnf() {
+    size_t nr_literals = 0;
+    for (const auto& clause: clauses) {
+      nr_literals += clause.size();
+    }
+    reserve(clauses.size(), nr_literals);
+    for (const auto& clause: clauses) {
+      add_clause(clause);
+    }
+  }
+
+  // The clause may be one of this formula's own, e.g. f.add_clause(f[i]).
+  void add_clause(std::span<const int> clause) {
+    if (contains(clause.data())) {
+      auto begin = clause.data() - literals.data();
+      auto end = literals.size();
+      literals.resize(end + clause.size());
+      std::copy_n(literals.begin() + begin, clause.size(), literals.begin() + end);
+    } else {
+      literals.insert(literals.end(), clause.begin(), clause.end());
+    }
+    offsets.push_back(literals.size());
+  }
+  void add_clause(std::initializer_list<int> clause) {
+    add_clause(std::span<const int>(clause.begin(), clause.size()));
+  }
+  // Build a clause literal by literal.
+  void push_literal(int literal) { literals.push_back(literal); }
+  void end_clause() { offsets.push_back(literals.size()); }
+  // Other may be this formula itself.
+  void append(const cnf& other) {
+    auto base = literals.size();
+    auto nr_literals = other.literals.size();
+    auto nr_offsets = other.offsets.size();
+    literals.resize(base + nr_literals);
+    std::copy_n(other.literals.begin(), nr_literals, literals.begin() + base);
+    offsets.reserve(offsets.size() + nr_offsets - 1);
+    for (size_t i = 1; i < nr_offsets; i++) {
+      offsets.push_back(base + other.offsets[i]);
+    }
+  }
+
+  size_t size() const { return offsets.size() - 1; }
+  bool empty() const { return size() == 0; }
+  size_t num_literals() const { return literals.size(); }
+  std::span<const int> operator[](size_t i) const { return std::span<const int>(literals.data() + offsets[i], literals.data() + offsets[i + 1]); }
+  std::span<int> operator[](size_t i) { return std::span<int>(literals.data() + offsets[i], literals.data() + offsets[i + 1]); }
+  // All literals of all clauses, e.g., to rename variables in place.
+  std::span<const int> all_literals() const { return literals; }
+  std::span<int> all_literals() { return literals; }
+
+  iterator begin() { return iterator(literals.data(), offsets.data()); }
+  iterator end() { return iterator(literals.data(), offsets.data() + size()); }
+  const_iterator begin() const { return const_iterator(literals.data(), offsets.data()); }
+  const_iterator end() const { return const_iterator(literals.data(), offsets.data() + size()); }
+
+  void reserve(size_t nr_clauses, size_t nr_literals) {
+    offsets.reserve(nr_clauses + 1);
+    literals.reserve(nr_literals);
+  }
+  void clear() {
+    literals.clear();
+    offsets.resize(1);
+  }
+  void shrink_to_fit() {
+    literals.shrink_to_fit();
+    offsets.shrink_to_fit();
+  }
+
+  std::vector<std::vector<int>> to_vectors() const {
+    std::vector<std::vector<int>> clauses;
+    clauses.reserve(size());
+    for (auto clause: *this) {
+      clauses.emplace_back(clause.begin(), clause.end());
+    }
+    return clauses;
+  }
+
+ private:
+  bool contains(const int* literal) const {
+    return !literals.empty() && std::less_equal<const int*>()(literals.data(), literal) && std::less<const int*>()(literal, literals.data() + literals.size());
+  }
+
+  std::vector<int> literals;
+  std::vector<size_t> offsets;
+};
+
+} // namespace definability_interpolation
+
+#endif /* CNF_HPP */
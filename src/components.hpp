@@ -0,0 +1,236 @@
+#ifndef COMPONENTS_HPP_
+#define COMPONENTS_HPP_
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cstdlib>
+
+#include "cnf.hpp"
+
+// A variable-connected component of a QBF matrix, renumbered to local variables 1..local_to_global.size() - 1.
+struct Component {
+  std::vector<int> variables;           // Local prefix variables, in prefix order.
+  std::vector<bool> is_existential;
+  definability_interpolation::cnf clauses; // Clauses over local variables.
+  std::vector<int> local_to_global;     // local_to_global[0] is unused.
+
+  int num_variables() const {
+    return static_cast<int>(local_to_global.size()) - 1;
+  }
+
+  int global_literal(int literal) const {
+    auto v = local_to_global[std::abs(literal)];
+    return literal < 0 ? -v : v;
+  }
+};
+
+// Split the matrix into components that are connected through existential (or free) variables.
+// Universal variables do not connect clauses; every component gets its own copy of the universals it mentions,
+// and clauses without existential variables are added to each component sharing a universal with them (or to every
+// component if none does). Existential variables that do not occur in any clause are collected in a single component.
+// Each component only keeps the constraints of its own clauses on the universals it shares with other components, so a
+// definition that relies on another component's constraints on the universals is not found. This is sound, but
+// can find fewer definitions than searching the whole matrix.
+inline std::vector<Component> decomposeComponents(int num_variables, const std::vector<int>& variables, const std::vector<bool>& is_existential, const definability_interpolation::cnf& clauses) {
+  int max_variable = num_variables;
+  for (auto l: clauses.all_literals()) {
+    max_variable = std::max(max_variable, std::abs(l));
+  }
+  for (auto v: variables) {
+    max_variable = std::max(max_variable, v);
+  }
+  // Variables missing from the prefix are free, i.e., existential.
+  std::vector<bool> universal(max_variable + 1, false);
+  for (size_t i = 0; i < variables.size(); i++) {
+    if (!is_existential[i]) {
+      universal[variables[i]] = true;
+    }
+  }
+
+  std::vector<int> parent(max_variable + 1);
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&parent](int v) {
+    while (parent[v] != v) {
+      parent[v] = parent[parent[v]];
+      v = parent[v];
+    }
+    return v;
+  };
+
+  std::vector<bool> occurs(max_variable + 1, false);
+  for (auto clause: clauses) {
+    int root = 0;
+    for (auto l: clause) {
+      auto v = std::abs(l);
+      occurs[v] = true;
+      if (universal[v]) {
+        continue;
+      }
+      auto r = find(v);
+      if (root == 0) {
+        root = r;
+      } else if (r != root) {
+        parent[r] = root;
+      }
+    }
+  }
+
+  // Number components in order of first appearance in the prefix, followed by free variables.
+  std::vector<int> root_to_component(max_variable + 1, -1);
+  std::vector<Component> components;
+  int unconstrained_component = -1;
+  auto component_of_existential = [&](int v) {
+    if (!occurs[v]) {
+      if (unconstrained_component < 0) {
+        unconstrained_component = components.size();
+        components.emplace_back();
+      }
+      return unconstrained_component;
+    }
+    auto r = find(v);
+    if (root_to_component[r] < 0) {
+      root_to_component[r] = components.size();
+      components.emplace_back();
+    }
+    return root_to_component[r];
+  };
+  for (size_t i = 0; i < variables.size(); i++) {
+    if (is_existential[i]) {
+      component_of_existential(variables[i]);
+    }
+  }
+  for (int v = 1; v <= max_variable; v++) {
+    if (occurs[v] && !universal[v]) {
+      component_of_existential(v);
+    }
+  }
+
+  // Distribute clauses and record which universals each component needs.
+  std::vector<std::vector<int>> universal_components(max_variable + 1);
+  std::vector<size_t> purely_universal;
+  for (size_t i = 0; i < clauses.size(); i++) {
+    int component = -1;
+    for (auto l: clauses[i]) {
+      if (!universal[std::abs(l)]) {
+        component = root_to_component[find(std::abs(l))];
+        break;
+      }
+    }
+    if (component < 0) {
+      purely_universal.push_back(i);
+      continue;
+    }
+    components[component].clauses.add_clause(clauses[i]);
+    for (auto l: clauses[i]) {
+      auto v = std::abs(l);
+      if (universal[v] && (universal_components[v].empty() || universal_components[v].back() != component)) {
+        universal_components[v].push_back(component);
+      }
+    }
+  }
+  // Clauses without existential variables link their universals. Each such clause goes to every component that needs a
+  // universal linked to it, which is the fixpoint of copying clauses to components sharing a universal with them and
+  // does not depend on the order of the clauses.
+  std::vector<int> universal_parent(max_variable + 1);
+  std::iota(universal_parent.begin(), universal_parent.end(), 0);
+  auto find_universal = [&universal_parent](int v) {
+    while (universal_parent[v] != v) {
+      universal_parent[v] = universal_parent[universal_parent[v]];
+      v = universal_parent[v];
+    }
+    return v;
+  };
+  std::vector<bool> linked(max_variable + 1, false);
+  for (auto i: purely_universal) {
+    int root = 0;
+    for (auto l: clauses[i]) {
+      auto v = std::abs(l);
+      linked[v] = true;
+      auto r = find_universal(v);
+      if (root == 0) {
+        root = r;
+      } else if (r != root) {
+        universal_parent[r] = root;
+      }
+    }
+  }
+  std::vector<std::vector<int>> group_components(max_variable + 1);
+  for (int v = 1; v <= max_variable; v++) {
+    if (linked[v]) {
+      auto& c = group_components[find_universal(v)];
+      c.insert(c.end(), universal_components[v].begin(), universal_components[v].end());
+    }
+  }
+  for (auto& c: group_components) {
+    std::sort(c.begin(), c.end());
+    c.erase(std::unique(c.begin(), c.end()), c.end());
+  }
+  // Groups that no component needs, and the empty clause, only matter if they are unsatisfiable, which makes every
+  // variable defined. They go to every component, so that the components see the same contradiction as the whole matrix.
+  std::vector<int> all_components(components.size());
+  std::iota(all_components.begin(), all_components.end(), 0);
+  for (int v = 1; v <= max_variable; v++) {
+    if (linked[v] && find_universal(v) == v && group_components[v].empty()) {
+      group_components[v] = all_components;
+    }
+  }
+  for (auto i: purely_universal) {
+    const auto& targets = clauses[i].empty() ? all_components : group_components[find_universal(std::abs(clauses[i][0]))];
+    for (auto component: targets) {
+      components[component].clauses.add_clause(clauses[i]);
+    }
+  }
+  for (int v = 1; v <= max_variable; v++) {
+    if (linked[v]) {
+      const auto& targets = group_components[find_universal(v)];
+      universal_components[v].insert(universal_components[v].end(), targets.begin(), targets.end());
+    }
+  }
+  for (auto& c: universal_components) {
+    std::sort(c.begin(), c.end());
+    c.erase(std::unique(c.begin(), c.end()), c.end());
+  }
+
+  // Renumber: prefix variables first (in prefix order), then free variables.
+  std::vector<int> global_to_local(max_variable + 1, 0);
+  std::vector<int> local_owner(max_variable + 1, -1);
+  for (auto& component: components) {
+    component.local_to_global.push_back(0);
+  }
+  for (size_t i = 0; i < variables.size(); i++) {
+    auto v = variables[i];
+    std::vector<int> targets;
+    if (is_existential[i]) {
+      targets.push_back(component_of_existential(v));
+    } else {
+      targets = universal_components[v];
+    }
+    for (auto c: targets) {
+      auto& component = components[c];
+      component.local_to_global.push_back(v);
+      component.variables.push_back(component.num_variables());
+      component.is_existential.push_back(is_existential[i]);
+    }
+  }
+  for (int c = 0; c < static_cast<int>(components.size()); c++) {
+    auto& component = components[c];
+    for (int local = 1; local <= component.num_variables(); local++) {
+      global_to_local[component.local_to_global[local]] = local;
+      local_owner[component.local_to_global[local]] = c;
+    }
+    for (auto& l: component.clauses.all_literals()) {
+      auto v = std::abs(l);
+      if (local_owner[v] != c) {
+        // Free variable.
+        component.local_to_global.push_back(v);
+        global_to_local[v] = component.num_variables();
+        local_owner[v] = c;
+      }
+      l = l < 0 ? -global_to_local[v] : global_to_local[v];
+    }
+  }
+  return components;
+}
+
+#endif // COMPONENTS_HPP_
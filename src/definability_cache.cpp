@@ -0,0 +1,99 @@
+#include "definability_cache.hpp"
+
+#include <algorithm>
+
+namespace definability_interpolation {
+
+definability_cache::fingerprint definability_cache::fingerprint_of(const std::vector<int>& variables) {
+  fingerprint result{0, 1};
+  for (auto v: variables) {
+    result.signature |= uint64_t(1) << (v & 63);
+    if (v == result.first_missing) {
+      result.first_missing++;
+    }
+  }
+  return result;
+}
+
+// A subset misses every variable the superset misses, so its first missing variable cannot come later.
+bool definability_cache::is_subset(const entry& subset, const fingerprint& key, const std::vector<int>& variables) {
+  return (subset.key.signature & ~key.signature) == 0 && subset.key.first_missing <= key.first_missing && subset.variables.size() <= variables.size()
+    && std::includes(variables.begin(), variables.end(), subset.variables.begin(), subset.variables.end());
+}
+
+bool definability_cache::is_superset(const entry& superset, const fingerprint& key, const std::vector<int>& variables) {
+  return (key.signature & ~superset.key.signature) == 0 && key.first_missing <= superset.key.first_missing && variables.size() <= superset.variables.size()
+    && std::includes(superset.variables.begin(), superset.variables.end(), variables.begin(), variables.end());
+}
+
+// Drop the oldest entries beyond the limit.
+void definability_cache::evict(std::vector<entry>& entries) {
+  if (entries.size() > max_entries_per_variable) {
+    entries.erase(entries.begin(), entries.end() - max_entries_per_variable);
+  }
+}
+
+bool definability_cache::known_defined(int variable, const std::vector<int>& shared_variables) const {
+  auto it = defined.find(variable);
+  if (it == defined.end()) {
+    return false;
+  }
+  auto key = fingerprint_of(shared_variables);
+  return std::any_of(it->second.begin(), it->second.end(), [&](const entry& e) { return is_subset(e, key, shared_variables); });
+}
+
+bool definability_cache::known_undefined(int variable, const std::vector<int>& shared_variables) const {
+  auto it = undefined.find(variable);
+  if (it == undefined.end()) {
+    return false;
+  }
+  auto key = fingerprint_of(shared_variables);
+  return std::any_of(it->second.begin(), it->second.end(), [&](const entry& e) { return is_superset(e, key, shared_variables); });
+}
+
+const definability_cache::definition* definability_cache::find_definition(int variable, const std::vector<int>& shared_variables, bool rewrite, InterpolationSystem system, bool compact_encoding) const {
+  auto it = defined.find(variable);
+  if (it == defined.end()) {
+    return nullptr;
+  }
+  auto key = fingerprint_of(shared_variables);
+  for (const auto& e: it->second) {
+    if (e.found && e.found->rewrite == rewrite && e.found->system == system && e.found->compact_encoding == compact_encoding && is_subset(e, key, shared_variables)) {
+      return &*e.found;
+    }
+  }
+  return nullptr;
+}
+
+void definability_cache::insert_defined(int variable, std::vector<int> shared_variables) {
+  auto& entries = defined[variable];
+  for (const auto& e: entries) {
+    if (e.variables == shared_variables) {
+      return;
+    }
+  }
+  auto key = fingerprint_of(shared_variables);
+  entries.push_back({key, std::move(shared_variables), std::nullopt});
+  evict(entries);
+}
+
+void definability_cache::insert_undefined(int variable, std::vector<int> shared_variables) {
+  auto& entries = undefined[variable];
+  auto key = fingerprint_of(shared_variables);
+  // Entries for subsets are implied by the new one.
+  std::erase_if(entries, [&](const entry& e) { return is_subset(e, key, shared_variables); });
+  entries.push_back({key, std::move(shared_variables), std::nullopt});
+  evict(entries);
+}
+
+void definability_cache::store_definition(int variable, const std::vector<int>& shared_variables, definition found) {
+  insert_defined(variable, shared_variables);
+  for (auto& e: defined[variable]) {
+    if (e.variables == shared_variables) {
+      e.found = std::move(found);
+      return;
+    }
+  }
+}
+
+} // namespace definability_interpolation
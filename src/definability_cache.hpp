@@ -0,0 +1,72 @@
+#ifndef DEFINABILITY_CACHE_HPP
+#define DEFINABILITY_CACHE_HPP
+
+#include "definability_interpolator.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace definability_interpolation {
+
+// Results of definability checks, per variable and set of shared variables.
+// Definability is monotone in the shared variables: a variable defined by S is defined by every superset of S,
+// and a variable not defined by S is not defined by any subset of S. Adding clauses preserves definedness, but
+// may turn undefined variables into defined ones.
+// Sets are stored sorted, together with a fingerprint that rules out most non-subsets without comparing the sets:
+// a 64-bit signature, selective for small sets, and the smallest variable missing from the set, selective for sets
+// that contain most variables. Only the most recent entries of each variable are kept.
+class definability_cache {
+ public:
+  static constexpr size_t max_entries_per_variable = 16;
+
+  // Definition clauses over original variables and auxiliary variables starting at auxiliary_start.
+  struct definition {
+    cnf clauses;
+    int auxiliary_start;
+    bool rewrite;
+    InterpolationSystem system;
+    bool compact_encoding;
+  };
+
+  // Both take sorted, duplicate-free shared variables.
+  bool known_defined(int variable, const std::vector<int>& shared_variables) const;
+  bool known_undefined(int variable, const std::vector<int>& shared_variables) const;
+  // A stored definition built with the given options over a subset of the shared variables.
+  const definition* find_definition(int variable, const std::vector<int>& shared_variables, bool rewrite, InterpolationSystem system, bool compact_encoding) const;
+
+  void insert_defined(int variable, std::vector<int> shared_variables);
+  void insert_undefined(int variable, std::vector<int> shared_variables);
+  // Attaches a definition to the entry for exactly these shared variables, creating it if needed.
+  void store_definition(int variable, const std::vector<int>& shared_variables, definition found);
+  void clear_undefined() { undefined.clear(); }
+  void clear() {
+    defined.clear();
+    undefined.clear();
+  }
+
+ private:
+  struct fingerprint {
+    uint64_t signature;
+    int first_missing;
+  };
+
+  struct entry {
+    fingerprint key;
+    std::vector<int> variables;
+    std::optional<definition> found;
+  };
+
+  static fingerprint fingerprint_of(const std::vector<int>& variables);
+  static bool is_subset(const entry& subset, const fingerprint& key, const std::vector<int>& variables);
+  static bool is_superset(const entry& superset, const fingerprint& key, const std::vector<int>& variables);
+  static void evict(std::vector<entry>& entries);
+
+  std::unordered_map<int, std::vector<entry>> defined;
+  std::unordered_map<int, std::vector<entry>> undefined;
+};
+
+} // namespace definability_interpolation
+
+#endif /* DEFINABILITY_CACHE_HPP */
@@ -2,8 +2,10 @@
 
 //#include <iostream>
 #include <algorithm>
+#include <barrier>
 #include <cassert>
 #include <unordered_set>
+#include <mutex>
 
 #include "opt/dar/dar.h"
 
@@ -11,13 +13,43 @@ using namespace abc; // Needed for macro expansion.
 
 namespace definability_interpolation {
 
+namespace {
+
+// Smallest core for which proofnodes are built in parallel, and the number of core clauses per additional thread.
+constexpr size_t min_parallel_core_size = 1024;
+// Levels with fewer clauses per thread are not worth a synchronization and are built by a single thread.
+constexpr size_t min_level_width_per_thread = 16;
+
+// The DAR rewriting library is a process-wide singleton in ABC, so interpolators living in different
+// threads share one reference-counted instance and must not rewrite concurrently.
+std::mutex dar_library_mutex;
+int dar_library_users = 0;
+
+} // namespace
+
 definability_interpolator::definability_interpolator(): empty_id(0) {
-  abc::Dar_LibStart();
+  std::lock_guard<std::mutex> lock(dar_library_mutex);
+  if (dar_library_users++ == 0) {
+    abc::Dar_LibStart();
+  }
 }
 
 definability_interpolator::~definability_interpolator() {
+  {
+    std::lock_guard<std::mutex> lock(worker_mutex);
+    worker_stop = true;
+  }
+  worker_condition.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+  results.clear();
+  worker_proofnodes.clear();
   clear_proofnodes();
-  abc::Dar_LibStop();
+  std::lock_guard<std::mutex> lock(dar_library_mutex);
+  if (--dar_library_users == 0) {
+    abc::Dar_LibStop();
+  }
 }
 
 void definability_interpolator::clear_proofnodes() {
@@ -46,6 +78,7 @@ void definability_interpolator::clear_proofnodes() {
     all_nodes.push_back(std::move(node));
   }
   clause_id_to_proofnode.clear();
+  leaf_to_clause_id.clear();
   for (auto& node : all_nodes) {
     node->left.reset();
     node->right.reset();
@@ -54,9 +87,10 @@ void definability_interpolator::clear_proofnodes() {
 
 void definability_interpolator::add_original_clause(int64_t id, bool redundant, const std::vector<int>& clause, bool restored) {
   if (restored) {
-    assert(clause_id_to_clause.contains(id));
+    assert(original_clauses.contains(id));
     return;
   }
+  wait_for_worker();
   // If the clause contains the literal 1, then it belongs to the first part of the formula.
   bool in_first_part = std::find(clause.begin(), clause.end(), 1) != clause.end();
   if (in_first_part) {
@@ -64,8 +98,10 @@ void definability_interpolator::add_original_clause(int64_t id, bool redundant,
       first_part_variables_set.insert(std::abs(l));
     }
   }
-  clause_id_to_clause[id] = clause;
-  clause_id_to_proofnode[id] = std::make_shared<binary_proofnode>(!in_first_part);
+  original_clauses.insert(id, clause);
+  auto leaf = std::make_shared<binary_proofnode>(!in_first_part);
+  leaf_to_clause_id[leaf.get()] = id;
+  clause_id_to_proofnode[id] = leaf;
   // Print clause and antecedents.
   // std::cout << "Adding clause " << id << std::endl;
   // std::cout << "Clause: ";
@@ -76,7 +112,7 @@ void definability_interpolator::add_original_clause(int64_t id, bool redundant,
 }
 
 void definability_interpolator::add_derived_clause(int64_t id, bool redundant, int witness, const std::vector<int>& clause, const std::vector<int64_t>& antecedents) {
-  clause_id_to_clause[id] = clause;
+  clauses.insert(id, clause);
   clause_id_to_antecedents[id] = antecedents;
   // Add an entry in the derivation node map.
   clause_id_to_derivation_node[id] = std::make_shared<clause_derivation_node>(id, *this);
@@ -119,34 +155,184 @@ void definability_interpolator::conclude_unsat(CaDiCaL::ConclusionType type, con
   empty_id = clause_ids[0];
 }
 
-std::pair<int, std::vector<std::vector<int>>> definability_interpolator::get_interpolant_clauses(const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig) {
-  auto output_variable = auxiliary_variable_start;
+std::pair<int, cnf> definability_interpolator::get_interpolant_clauses(const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig, InterpolationSystem system, bool compact_encoding) {
+  wait_for_worker();
   create_core_proofnodes();
-  auto rootnode = clause_id_to_proofnode.at(empty_id);
-  aig_man = abc::Aig_ManStart(shared_variables.size());
-  auto aig_input_variables = construct_aig(shared_variables);
-  Aig_ManCleanup(aig_man);
-  // Rewrite AIG if necessary.
-  if (abc::Aig_ManNodeNum(aig_man) > 0 && rewrite_aig) {
-    //std::cout << "Number of nodes before: " << Aig_ManNodeNum(aig_man) << std::endl;
-    aig_man = Dar_ManRewriteDefault(aig_man);
-    //std::cout << "Number of nodes after: " << Aig_ManNodeNum(aig_man) << std::endl;
-  }
-  std::vector<std::vector<int>> interpolant_clauses;
-  interpolant_clauses.reserve(Aig_ManNodeNum(aig_man));
+  return interpolate(clause_id_to_proofnode.at(empty_id), shared_variables, auxiliary_variable_start, rewrite_aig, system, compact_encoding);
+}
+
+void definability_interpolator::submit_interpolant(const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig, InterpolationSystem system, bool compact_encoding) {
+  interpolation_job job{empty_id, get_core()};
+  for (auto id: job.core) {
+    const auto& antecedents = clause_id_to_antecedents.at(id);
+    for (auto antecedent_id: antecedents) {
+      if (job.literals.contains(antecedent_id)) {
+        continue;
+      }
+      auto& literals = job.literals[antecedent_id];
+      auto decoder = decode_clause(antecedent_id);
+      int literal;
+      while (decoder.next(literal)) {
+        literals.push_back(literal);
+      }
+      auto it = clause_id_to_proofnode.find(antecedent_id);
+      if (it != clause_id_to_proofnode.end()) {
+        job.proofnodes.emplace(antecedent_id, it->second);
+      }
+    }
+    job.antecedents.emplace(id, antecedents);
+  }
+  if (job.core.empty()) {
+    job.proofnodes.emplace(empty_id, clause_id_to_proofnode.at(empty_id));
+  }
+  job.shared_variables = shared_variables;
+  job.auxiliary_variable_start = auxiliary_variable_start;
+  job.rewrite_aig = rewrite_aig;
+  job.system = system;
+  job.compact_encoding = compact_encoding;
+  {
+    std::lock_guard<std::mutex> lock(worker_mutex);
+    jobs.push_back(std::move(job));
+    nr_pending++;
+    if (!worker.joinable()) {
+      worker = std::thread(&definability_interpolator::run_worker, this);
+    }
+  }
+  worker_condition.notify_all();
+}
+
+std::pair<int, cnf> definability_interpolator::next_interpolant() {
+  std::unique_lock<std::mutex> lock(worker_mutex);
+  assert(nr_pending > 0);
+  worker_condition.wait(lock, [this]() { return !results.empty(); });
+  auto result = std::move(results.front());
+  results.pop_front();
+  nr_pending--;
+  lock.unlock();
+  if (result.error) {
+    std::rethrow_exception(result.error);
+  }
+  // Keep the proofnodes of clauses that are still alive, so that later refutations can reuse them.
+  for (auto& [id, proofnode]: result.proofnodes) {
+    if (clause_id_to_antecedents.contains(id) && !clause_id_to_proofnode.contains(id)) {
+      clause_id_to_proofnode.emplace(id, std::move(proofnode));
+      if (clause_id_to_derivation_node.contains(id)) {
+        clause_id_to_derivation_node.at(id)->antecedents.clear();
+      }
+    }
+  }
+  return std::move(result.interpolant);
+}
+
+size_t definability_interpolator::pending_interpolants() const {
+  std::lock_guard<std::mutex> lock(worker_mutex);
+  return nr_pending;
+}
+
+void definability_interpolator::wait_for_worker() {
+  std::unique_lock<std::mutex> lock(worker_mutex);
+  worker_condition.wait(lock, [this]() { return jobs.empty() && !worker_busy; });
+}
+
+void definability_interpolator::run_worker() {
+  std::unique_lock<std::mutex> lock(worker_mutex);
+  while (true) {
+    worker_condition.wait(lock, [this]() { return worker_stop || !jobs.empty(); });
+    if (jobs.empty()) {
+      return;
+    }
+    auto job = std::move(jobs.front());
+    jobs.pop_front();
+    worker_busy = true;
+    lock.unlock();
+    interpolation_result result;
+    try {
+      auto proofnode_of = [&](int64_t id) -> const std::shared_ptr<binary_proofnode>& {
+        auto it = job.proofnodes.find(id);
+        return it != job.proofnodes.end() ? it->second : worker_proofnodes.at(id);
+      };
+      auto decoder_of = [&job](int64_t id) { return literal_decoder(job.literals.at(id)); };
+      for (auto id: job.core) {
+        // Segments of consecutive jobs overlap while earlier results have not been merged.
+        auto it = worker_proofnodes.find(id);
+        if (it == worker_proofnodes.end()) {
+          it = worker_proofnodes.emplace(id, resolve_antecedents(job.antecedents.at(id), proofnode_of, decoder_of, worker_marking)).first;
+        }
+        result.proofnodes.emplace_back(id, it->second);
+      }
+      result.interpolant = interpolate(proofnode_of(job.empty_id), job.shared_variables, job.auxiliary_variable_start, job.rewrite_aig, job.system, job.compact_encoding);
+    } catch (...) {
+      result.error = std::current_exception();
+    }
+    lock.lock();
+    results.push_back(std::move(result));
+    worker_busy = false;
+    if (jobs.empty()) {
+      worker_proofnodes.clear();
+    }
+    worker_condition.notify_all();
+  }
+}
+
+// Build, optionally rewrite and encode the interpolant of the refutation rooted at rootnode.
+std::pair<int, cnf> definability_interpolator::interpolate(const std::shared_ptr<binary_proofnode>& rootnode, const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig, InterpolationSystem system, bool compact_encoding) {
+  std::vector<InterpolationSystem> candidates = {system};
+  if (system == InterpolationSystem::SMALLEST) {
+    candidates = {InterpolationSystem::PUDLAK, InterpolationSystem::MCMILLAN, InterpolationSystem::MCMILLAN_DUAL};
+  }
+  // Build an AIG for every candidate system and keep the smallest one (the first one on ties).
+  abc::Aig_Man_t* smallest_aig_man = nullptr;
+  std::vector<int> aig_input_variables;
+  for (auto candidate: candidates) {
+    aig_man = abc::Aig_ManStart(shared_variables.size());
+    auto candidate_input_variables = construct_aig(rootnode, shared_variables, candidate);
+    Aig_ManCleanup(aig_man);
+    // Rewrite AIG if necessary.
+    if (abc::Aig_ManNodeNum(aig_man) > 0 && rewrite_aig) {
+      //std::cout << "Number of nodes before: " << Aig_ManNodeNum(aig_man) << std::endl;
+      std::lock_guard<std::mutex> lock(dar_library_mutex);
+      auto original_aig_man = aig_man;
+      aig_man = Dar_ManRewriteDefault(original_aig_man); // Works on a copy that preserves the order of CIs.
+      abc::Aig_ManStop(original_aig_man);
+      //std::cout << "Number of nodes after: " << Aig_ManNodeNum(aig_man) << std::endl;
+    }
+    if (smallest_aig_man == nullptr || abc::Aig_ManNodeNum(aig_man) < abc::Aig_ManNodeNum(smallest_aig_man)) {
+      if (smallest_aig_man != nullptr) {
+        abc::Aig_ManStop(smallest_aig_man);
+      }
+      smallest_aig_man = aig_man;
+      aig_input_variables = std::move(candidate_input_variables);
+    } else {
+      abc::Aig_ManStop(aig_man);
+    }
+  }
+  aig_man = smallest_aig_man;
+  cnf interpolant_clauses;
+  // Three clauses with at most three literals per AND node in the Tseitin encoding.
+  interpolant_clauses.reserve(3 * Aig_ManNodeNum(aig_man) + 3, 7 * Aig_ManNodeNum(aig_man) + 5);
+  abc::Aig_Obj_t * pObj;
+  int i;
+  assert(abc::Aig_ManCoNum(aig_man) == 1);
+  // Assign shared variables to CIs.
+  Aig_ManForEachCi( aig_man, pObj, i) {
+    pObj->iData = aig_input_variables[i];
+  }
+  auto output_literal = compact_encoding ? encode_aig_compact(auxiliary_variable_start, interpolant_clauses) : encode_aig_tseitin(auxiliary_variable_start, interpolant_clauses);
+  abc::Aig_ManStop(aig_man);
+  return std::make_pair(output_literal, interpolant_clauses);
+}
+
+// Plain Tseitin encoding: one auxiliary variable and three clauses per AND node, plus the constant and the output.
+int definability_interpolator::encode_aig_tseitin(int auxiliary_variable_start, cnf& interpolant_clauses) {
+  auto output_variable = auxiliary_variable_start;
   abc::Vec_Ptr_t * vNodes;
   abc::Aig_Obj_t * pObj, * pConst1 = NULL;
   int i;
-  assert(abc::Aig_ManCoNum(aig_man) == 1);
   // check if constant is used
   Aig_ManForEachCo( aig_man, pObj, i) {
     if (abc::Aig_ObjIsConst1(abc::Aig_ObjFanin0(pObj)))
       pConst1 = abc::Aig_ManConst1(aig_man);
   }
-  // Assign shared variables to CIs.
-  Aig_ManForEachCi( aig_man, pObj, i) {
-    pObj->iData = aig_input_variables[i];
-  }
   // collect nodes in the DFS order
   vNodes = abc::Aig_ManDfs(aig_man, 1);
   // assign IDs to objects
@@ -159,7 +345,7 @@ std::pair<int, std::vector<std::vector<int>>> definability_interpolator::get_int
   }
   // Add clauses from Tseitin conversion.
   if (pConst1) { // Constant 1 if necessary.
-    interpolant_clauses.push_back( { pConst1->iData } );
+    interpolant_clauses.add_clause( { pConst1->iData } );
   }
   Vec_PtrForEachEntry( abc::Aig_Obj_t *, vNodes, pObj, i ) {
     auto variable_output = pObj->iData;
@@ -167,21 +353,262 @@ std::pair<int, std::vector<std::vector<int>>> definability_interpolator::get_int
     auto variable_input1 = abc::Aig_ObjFanin1(pObj)->iData;
     auto literal_input0 = Aig_ObjFaninC0(pObj) ? -variable_input0 : variable_input0;
     auto literal_input1 = Aig_ObjFaninC1(pObj) ? -variable_input1 : variable_input1;
-    interpolant_clauses.push_back( { literal_input0, -variable_output } );
-    interpolant_clauses.push_back( { literal_input1, -variable_output } );
-    interpolant_clauses.push_back( { -literal_input0, -literal_input1, variable_output } );
+    interpolant_clauses.add_clause( { literal_input0, -variable_output } );
+    interpolant_clauses.add_clause( { literal_input1, -variable_output } );
+    interpolant_clauses.add_clause( { -literal_input0, -literal_input1, variable_output } );
   }
   // Write clauses for PO.
   Aig_ManForEachCo( aig_man, pObj, i ) {
     auto variable_output = pObj->iData;
     auto variable_input0 = abc::Aig_ObjFanin0(pObj)->iData;
     auto literal_input0 = Aig_ObjFaninC0(pObj) ? -variable_input0 : variable_input0;
-    interpolant_clauses.push_back( { literal_input0, -variable_output } );
-    interpolant_clauses.push_back( { -literal_input0, variable_output } );
+    interpolant_clauses.add_clause( { literal_input0, -variable_output } );
+    interpolant_clauses.add_clause( { -literal_input0, variable_output } );
   }
   abc::Vec_PtrFree(vNodes);
-  abc::Aig_ManStop(aig_man);
-  return std::make_pair(output_variable, interpolant_clauses);
+  return output_variable;
+}
+
+namespace {
+
+// Polarities in which a gate output is used.
+constexpr uint8_t positive_polarity = 1;
+constexpr uint8_t negative_polarity = 2;
+constexpr uint8_t both_polarities = positive_polarity | negative_polarity;
+
+uint8_t flip_polarity(uint8_t polarity) {
+  return ((polarity & positive_polarity) << 1) | ((polarity & negative_polarity) >> 1);
+}
+
+// A gate of the compact encoding. Inputs are (possibly complemented) AIG objects:
+// AND gates have any number of inputs, MUX gates are (control, then, else), XOR gates have two inputs.
+struct compact_gate {
+  enum class Type { AND, MUX, XOR };
+  Type type;
+  std::vector<abc::Aig_Obj_t*> inputs;
+  int variable;
+  uint8_t polarity;
+};
+
+// Decompose an AND node of the form AND(NOT AND(c, a), NOT AND(NOT c, b)) into control and data inputs,
+// provided both inner nodes are used only here. The node then computes c ? NOT a : NOT b, with c regular.
+bool recognize_mux(abc::Aig_Obj_t* node, const std::unordered_map<abc::Aig_Obj_t*, int>& references, abc::Aig_Obj_t*& control, abc::Aig_Obj_t*& then_input, abc::Aig_Obj_t*& else_input) {
+  if (!abc::Aig_ObjFaninC0(node) || !abc::Aig_ObjFaninC1(node)) {
+    return false;
+  }
+  auto p = abc::Aig_ObjFanin0(node);
+  auto q = abc::Aig_ObjFanin1(node);
+  if (!abc::Aig_ObjIsAnd(p) || !abc::Aig_ObjIsAnd(q) || references.at(p) != 1 || references.at(q) != 1) {
+    return false;
+  }
+  abc::Aig_Obj_t* p_children[2] = {abc::Aig_ObjChild0(p), abc::Aig_ObjChild1(p)};
+  abc::Aig_Obj_t* q_children[2] = {abc::Aig_ObjChild0(q), abc::Aig_ObjChild1(q)};
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 2; j++) {
+      if (p_children[i] != abc::Aig_Not(q_children[j])) {
+        continue;
+      }
+      auto c = p_children[i];
+      auto a = p_children[1 - i];
+      auto b = q_children[1 - j];
+      if (abc::Aig_IsComplement(c)) {
+        std::swap(a, b);
+      }
+      control = abc::Aig_Regular(c);
+      then_input = abc::Aig_Not(a);
+      else_input = abc::Aig_Not(b);
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+// Compact encoding: AND trees whose inner nodes have a single fanout are collapsed into n-ary gates,
+// multiplexers and XORs are encoded directly, inputs and the constant need no gate of their own,
+// and clauses are only emitted for the polarities in which a gate is used (Plaisted-Greenbaum).
+// The output of a definition is bi-implied with the defined variable, so it is used in both polarities.
+int definability_interpolator::encode_aig_compact(int auxiliary_variable_start, cnf& interpolant_clauses) {
+  abc::Aig_Obj_t * pObj;
+  int i;
+  abc::Aig_Obj_t* root = nullptr;
+  Aig_ManForEachCo( aig_man, pObj, i ) {
+    root = abc::Aig_ObjChild0(pObj);
+  }
+  auto root_node = abc::Aig_Regular(root);
+  if (abc::Aig_ObjIsConst1(root_node)) {
+    // Constant definition.
+    auto variable = auxiliary_variable_start;
+    interpolant_clauses.add_clause( { abc::Aig_IsComplement(root) ? -variable : variable } );
+    return variable;
+  }
+  if (abc::Aig_ObjIsCi(root_node)) {
+    // The definition is a literal over the shared variables.
+    return abc::Aig_IsComplement(root) ? -root_node->iData : root_node->iData;
+  }
+
+  // Count references within the cone of the output.
+  std::unordered_map<abc::Aig_Obj_t*, int> references;
+  std::vector<abc::Aig_Obj_t*> stack = {root_node};
+  references[root_node] = 1;
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    for (auto fanin: {abc::Aig_ObjFanin0(node), abc::Aig_ObjFanin1(node)}) {
+      if (!abc::Aig_ObjIsAnd(fanin)) {
+        continue;
+      }
+      if (references[fanin]++ == 0) {
+        stack.push_back(fanin);
+      }
+    }
+  }
+
+  auto is_mux = [&references](abc::Aig_Obj_t* node) {
+    abc::Aig_Obj_t *control, *then_input, *else_input;
+    return recognize_mux(node, references, control, then_input, else_input);
+  };
+
+  // Recognize gates, ordered so that every gate comes after the gates it reads.
+  std::unordered_map<abc::Aig_Obj_t*, int> node_to_gate;
+  std::unordered_map<abc::Aig_Obj_t*, compact_gate> pending;
+  std::vector<compact_gate> gates;
+  std::vector<std::pair<abc::Aig_Obj_t*, bool>> gate_stack = {{root_node, false}};
+  while (!gate_stack.empty()) {
+    auto [node, expanded] = gate_stack.back();
+    gate_stack.pop_back();
+    if (node_to_gate.contains(node)) {
+      continue;
+    }
+    if (expanded) {
+      node_to_gate[node] = gates.size();
+      gates.push_back(std::move(pending.at(node)));
+      pending.erase(node);
+      continue;
+    }
+    if (pending.contains(node)) {
+      continue;
+    }
+    compact_gate gate;
+    gate.variable = 0;
+    gate.polarity = 0;
+    abc::Aig_Obj_t *control, *then_input, *else_input;
+    if (recognize_mux(node, references, control, then_input, else_input)) {
+      if (then_input == abc::Aig_Not(else_input)) {
+        // c ? t : NOT t is the XOR of c and NOT t.
+        gate.type = compact_gate::Type::XOR;
+        gate.inputs = {control, else_input};
+      } else {
+        gate.type = compact_gate::Type::MUX;
+        gate.inputs = {control, then_input, else_input};
+      }
+    } else {
+      // Collapse the AND tree rooted at this node.
+      gate.type = compact_gate::Type::AND;
+      std::vector<abc::Aig_Obj_t*> conjuncts = {abc::Aig_ObjChild0(node), abc::Aig_ObjChild1(node)};
+      while (!conjuncts.empty()) {
+        auto conjunct = conjuncts.back();
+        conjuncts.pop_back();
+        auto conjunct_node = abc::Aig_Regular(conjunct);
+        if (!abc::Aig_IsComplement(conjunct) && abc::Aig_ObjIsAnd(conjunct_node) && references.at(conjunct_node) == 1 && !is_mux(conjunct_node)) {
+          conjuncts.push_back(abc::Aig_ObjChild0(conjunct_node));
+          conjuncts.push_back(abc::Aig_ObjChild1(conjunct_node));
+        } else {
+          gate.inputs.push_back(conjunct);
+        }
+      }
+    }
+    gate_stack.push_back({node, true});
+    for (auto input: gate.inputs) {
+      auto input_node = abc::Aig_Regular(input);
+      if (abc::Aig_ObjIsAnd(input_node) && !node_to_gate.contains(input_node)) {
+        gate_stack.push_back({input_node, false});
+      }
+    }
+    pending.emplace(node, std::move(gate));
+  }
+
+  // Propagate polarities from the output towards the inputs.
+  gates.back().polarity = both_polarities;
+  for (auto it = gates.rbegin(); it != gates.rend(); it++) {
+    for (size_t k = 0; k < it->inputs.size(); k++) {
+      auto input = it->inputs[k];
+      auto input_node = abc::Aig_Regular(input);
+      if (!abc::Aig_ObjIsAnd(input_node)) {
+        continue;
+      }
+      uint8_t polarity = abc::Aig_IsComplement(input) ? flip_polarity(it->polarity) : it->polarity;
+      if (it->type == compact_gate::Type::XOR || (it->type == compact_gate::Type::MUX && k == 0)) {
+        polarity = both_polarities;
+      }
+      gates[node_to_gate.at(input_node)].polarity |= polarity;
+    }
+  }
+
+  // Assign variables and emit clauses.
+  auto constant_variable = 0;
+  auto literal = [&](abc::Aig_Obj_t* input) {
+    auto input_node = abc::Aig_Regular(input);
+    int variable;
+    if (abc::Aig_ObjIsCi(input_node)) {
+      variable = input_node->iData;
+    } else if (abc::Aig_ObjIsConst1(input_node)) {
+      if (constant_variable == 0) {
+        constant_variable = auxiliary_variable_start++;
+        interpolant_clauses.add_clause( { constant_variable } );
+      }
+      variable = constant_variable;
+    } else {
+      variable = gates[node_to_gate.at(input_node)].variable;
+    }
+    return abc::Aig_IsComplement(input) ? -variable : variable;
+  };
+  std::vector<int> long_clause;
+  for (auto& gate: gates) {
+    gate.variable = auxiliary_variable_start++;
+    auto g = gate.variable;
+    bool positive = gate.polarity & positive_polarity;
+    bool negative = gate.polarity & negative_polarity;
+    if (gate.type == compact_gate::Type::AND) {
+      long_clause.assign(1, g);
+      for (auto input: gate.inputs) {
+        auto l = literal(input);
+        if (positive) {
+          interpolant_clauses.add_clause( { -g, l } );
+        }
+        long_clause.push_back(-l);
+      }
+      if (negative) {
+        interpolant_clauses.add_clause(long_clause);
+      }
+    } else if (gate.type == compact_gate::Type::MUX) {
+      auto c = literal(gate.inputs[0]);
+      auto t = literal(gate.inputs[1]);
+      auto e = literal(gate.inputs[2]);
+      if (positive) {
+        interpolant_clauses.add_clause( { -g, -c, t } );
+        interpolant_clauses.add_clause( { -g, c, e } );
+      }
+      if (negative) {
+        interpolant_clauses.add_clause( { g, -c, -t } );
+        interpolant_clauses.add_clause( { g, c, -e } );
+      }
+    } else {
+      auto a = literal(gate.inputs[0]);
+      auto b = literal(gate.inputs[1]);
+      if (positive) {
+        interpolant_clauses.add_clause( { -g, a, b } );
+        interpolant_clauses.add_clause( { -g, -a, -b } );
+      }
+      if (negative) {
+        interpolant_clauses.add_clause( { g, -a, b } );
+        interpolant_clauses.add_clause( { g, a, -b } );
+      }
+    }
+  }
+  auto output_variable = gates.back().variable;
+  return abc::Aig_IsComplement(root) ? -output_variable : output_variable;
 }
 
 // Get the clause ids in the core of the proof that do not already have a proofnode.
@@ -211,46 +638,61 @@ std::vector<int64_t> definability_interpolator::get_core() const {
   return core;
 }
 
-uint8_t definability_interpolator::mark_literal (int literal) {
+uint8_t definability_interpolator::marking_scratch::mark_literal (int literal) {
   int index = std::abs (literal);
   uint8_t mask = (literal < 0) ? 2 : 1;
   uint8_t was_marked = marks[index];
   if (!was_marked)
-    marking_history.push_back(index);
+    history.push_back(index);
   if (!(was_marked & mask))
     marks[index] |= mask;
   return was_marked & ~mask;
 }
 
-void definability_interpolator::unmark_all() {
-  for (auto& index: marking_history) {
+void definability_interpolator::marking_scratch::unmark_all() {
+  for (auto& index: history) {
     marks[index] = 0;
   }
-  marking_history.clear();
+  history.clear();
 }
 
-void definability_interpolator::create_derived_proofnode(int64_t id) {
-  const auto& antecedents = clause_id_to_antecedents.at(id);
-  // All antecedents must already have a proofnode.
-  #ifndef NDEBUG
-  for (auto &clause_id: antecedents)
-    assert(clause_id_to_proofnode.contains(clause_id));
-  #endif
+clause_store::decoder definability_interpolator::decode_clause(int64_t id) const {
+  return original_clauses.contains(id) ? original_clauses.decode(id) : clauses.decode(id);
+}
 
-  auto running_proofnode = clause_id_to_proofnode.at(antecedents.back());
+// Resolve the antecedents of a derived clause, from last to first, into a chain of binary proofnodes.
+template <typename ProofnodeOf, typename DecoderOf>
+std::shared_ptr<definability_interpolator::binary_proofnode> definability_interpolator::resolve_antecedents(const std::vector<int64_t>& antecedents, ProofnodeOf proofnode_of, DecoderOf decoder_of, marking_scratch& marking) {
+  auto running_proofnode = proofnode_of(antecedents.back());
 
   for (int i = antecedents.size() - 1; i >= 0; i--) {
     auto antecedent_id = antecedents[i];
-    auto antecedent_clause = clause_id_to_clause.at(antecedent_id);
-    auto antecedent_proofnode = clause_id_to_proofnode.at(antecedent_id);
-    for (auto literal: antecedent_clause) {
-      if (!mark_literal(literal))
+    auto antecedent_proofnode = proofnode_of(antecedent_id);
+    auto decoder = decoder_of(antecedent_id);
+    int literal;
+    while (decoder.next(literal)) {
+      if (!marking.mark_literal(literal))
         continue;
       running_proofnode = std::make_shared<binary_proofnode>(literal, antecedent_proofnode, running_proofnode);
     }
   }
-  unmark_all();
-  clause_id_to_proofnode[id] = running_proofnode;
+  marking.unmark_all();
+  return running_proofnode;
+}
+
+void definability_interpolator::create_derived_proofnode(int64_t id) {
+  const auto& antecedents = clause_id_to_antecedents.at(id);
+  // All antecedents must already have a proofnode.
+  #ifndef NDEBUG
+  for (auto &clause_id: antecedents)
+    assert(clause_id_to_proofnode.contains(clause_id));
+  #endif
+
+  // Stream the literals straight out of the compressed clause stores.
+  clause_id_to_proofnode[id] = resolve_antecedents(antecedents,
+    [this](int64_t antecedent_id) -> const std::shared_ptr<binary_proofnode>& { return clause_id_to_proofnode.at(antecedent_id); },
+    [this](int64_t antecedent_id) { return decode_clause(antecedent_id); },
+    marking);
   //std::cout << "Creating proofnode for clause " << id << std::endl;
   if (clause_id_to_derivation_node.contains(id)) {
     clause_id_to_derivation_node.at(id)->antecedents.clear(); // It's safe to delete the antecedents now.
@@ -266,18 +708,167 @@ void definability_interpolator::create_core_proofnodes() {
   //   std::cout << id << " ";
   // }
   // std::cout << std::endl;
+  if (proofnode_threads > 1 && core.size() >= min_parallel_core_size) {
+    create_core_proofnodes_parallel(core);
+    return;
+  }
   // Create proofnodes for each clause in the core.
   for (auto it = core.begin(); it != core.end(); it++) {
     create_derived_proofnode(*it);
   }
 }
 
-void definability_interpolator::process_node(const std::shared_ptr<binary_proofnode>& proofnode, std::unordered_map<std::shared_ptr<binary_proofnode>, abc::Aig_Obj_t*>& proofnode_to_aig_node, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables, std::unordered_set<int>& shared_variables_set) {
+// Levelise the core: a clause is on the level after the deepest of its antecedents in the core, so the clauses of a level
+// only depend on proofnodes that exist once the previous levels are done. Every thread resolves its share of a wide level
+// with its own marking scratch into its own buffer, and the buffers are merged into the proof DAG between levels.
+// Cores of learned clauses tend to be deep and narrow, so runs of consecutive narrow levels are built in order by a single
+// thread, with one synchronization per run instead of per level.
+// Each chain depends only on its antecedents' proofnodes and literals, so the DAG is the one built sequentially.
+void definability_interpolator::create_core_proofnodes_parallel(const std::vector<int64_t>& core) {
+  // The core is in topological order.
+  std::unordered_map<int64_t, size_t> level_of;
+  std::vector<std::vector<int64_t>> levels;
+  for (auto id: core) {
+    size_t level = 0;
+    for (auto antecedent_id: clause_id_to_antecedents.at(id)) {
+      auto it = level_of.find(antecedent_id);
+      if (it != level_of.end()) {
+        level = std::max(level, it->second + 1);
+      }
+    }
+    level_of.emplace(id, level);
+    if (level == levels.size()) {
+      levels.emplace_back();
+    }
+    levels[level].push_back(id);
+  }
+
+  // Group the levels into steps: wide levels are built in parallel, runs of narrow levels in order.
+  struct step {
+    bool parallel;
+    std::vector<int64_t> ids;
+  };
+  auto nr_threads = std::min(proofnode_threads, std::max<size_t>(core.size() / min_parallel_core_size, 2));
+  std::vector<step> steps;
+  for (auto& ids: levels) {
+    bool wide = ids.size() >= nr_threads * min_level_width_per_thread;
+    if (wide || steps.empty() || steps.back().parallel) {
+      steps.push_back({wide, std::move(ids)});
+    } else {
+      steps.back().ids.insert(steps.back().ids.end(), ids.begin(), ids.end());
+    }
+  }
+  if (std::none_of(steps.begin(), steps.end(), [](const step& s) { return s.parallel; })) {
+    for (auto id: core) {
+      create_derived_proofnode(id);
+    }
+    return;
+  }
+
+  std::vector<marking_scratch> thread_marking(nr_threads - 1);
+  std::vector<std::vector<std::pair<int64_t, std::shared_ptr<binary_proofnode>>>> thread_proofnodes(nr_threads);
+  size_t current = 0;
+  auto merge = [&]() noexcept {
+    for (auto& proofnodes: thread_proofnodes) {
+      for (auto& [id, proofnode]: proofnodes) {
+        clause_id_to_proofnode[id] = std::move(proofnode);
+        if (clause_id_to_derivation_node.contains(id)) {
+          clause_id_to_derivation_node.at(id)->antecedents.clear(); // It's safe to delete the antecedents now.
+        }
+      }
+      proofnodes.clear();
+    }
+    current++;
+  };
+  std::barrier step_done(nr_threads, merge);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  // The proof DAG is only read while a wide level is resolved, and only written by the merge or by thread 0 while the
+  // other threads wait for a run of narrow levels.
+  auto build = [&](size_t t) {
+    auto& scratch = t == 0 ? marking : thread_marking[t - 1];
+    auto proofnode_of = [this](int64_t antecedent_id) -> const std::shared_ptr<binary_proofnode>& { return clause_id_to_proofnode.at(antecedent_id); };
+    auto decoder_of = [this](int64_t antecedent_id) { return decode_clause(antecedent_id); };
+    while (current < steps.size()) {
+      const auto& [parallel, ids] = steps[current];
+      try {
+        if (parallel) {
+          for (size_t k = t; k < ids.size(); k += nr_threads) {
+            thread_proofnodes[t].emplace_back(ids[k], resolve_antecedents(clause_id_to_antecedents.at(ids[k]), proofnode_of, decoder_of, scratch));
+          }
+        } else if (t == 0) {
+          for (auto id: ids) {
+            create_derived_proofnode(id);
+          }
+        }
+      } catch (...) {
+        scratch.unmark_all();
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+      }
+      step_done.arrive_and_wait();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < nr_threads; t++) {
+    threads.emplace_back(build, t);
+  }
+  build(0);
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+abc::Aig_Obj_t* definability_interpolator::input_node(int variable, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables) {
+  // If there's no CI for the variable, create one.
+  if (!variable_to_ci.contains(variable)) {
+    aig_input_variables.push_back(variable);
+    variable_to_ci[variable] = abc::Aig_ObjCreateCi(aig_man);
+  }
+  return variable_to_ci.at(variable);
+}
+
+abc::Aig_Obj_t* definability_interpolator::leaf_node(const std::shared_ptr<binary_proofnode>& proofnode, InterpolationSystem system, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables, std::unordered_set<int>& shared_variables_set) {
+  bool in_first_part = !proofnode->label;
+  if (system == InterpolationSystem::MCMILLAN && in_first_part) {
+    // Disjunction of the shared literals in the clause.
+    auto node = abc::Aig_ManConst0(aig_man);
+    auto decoder = original_clauses.decode(leaf_to_clause_id.at(proofnode.get()));
+    int literal;
+    while (decoder.next(literal)) {
+      if (shared_variables_set.contains(std::abs(literal))) {
+        auto variable_node = input_node(std::abs(literal), variable_to_ci, aig_input_variables);
+        node = abc::Aig_Or(aig_man, node, abc::Aig_NotCond(variable_node, literal < 0));
+      }
+    }
+    return node;
+  } else if (system == InterpolationSystem::MCMILLAN_DUAL && !in_first_part) {
+    // Conjunction of the negated shared literals in the clause.
+    auto node = abc::Aig_ManConst1(aig_man);
+    auto decoder = original_clauses.decode(leaf_to_clause_id.at(proofnode.get()));
+    int literal;
+    while (decoder.next(literal)) {
+      if (shared_variables_set.contains(std::abs(literal))) {
+        auto variable_node = input_node(std::abs(literal), variable_to_ci, aig_input_variables);
+        node = abc::Aig_And(aig_man, node, abc::Aig_NotCond(variable_node, literal > 0));
+      }
+    }
+    return node;
+  }
+  // Constant 0 or 1.
+  return in_first_part ? abc::Aig_ManConst0(aig_man) : abc::Aig_ManConst1(aig_man);
+}
+
+void definability_interpolator::process_node(const std::shared_ptr<binary_proofnode>& proofnode, InterpolationSystem system, std::unordered_map<std::shared_ptr<binary_proofnode>, abc::Aig_Obj_t*>& proofnode_to_aig_node, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables, std::unordered_set<int>& shared_variables_set) {
   // The node must not have been processed.
   assert(!proofnode_to_aig_node.contains(proofnode));
   if (proofnode->left == nullptr && proofnode->right == nullptr) {
-    // Leaf node: constant 0 or 1.
-    auto new_node = proofnode->label ? abc::Aig_ManConst1(aig_man) : abc::Aig_ManConst0(aig_man);
+    // Leaf node.
+    auto new_node = leaf_node(proofnode, system, variable_to_ci, aig_input_variables, shared_variables_set);
     proofnode_to_aig_node[proofnode] = new_node;
     //abc::Aig_ObjPrint(aig_man, new_node);
   } else {
@@ -288,18 +879,19 @@ void definability_interpolator::process_node(const std::shared_ptr<binary_proofn
     assert(proofnode->label);
     int variable = abs(proofnode->label);
     if (shared_variables_set.contains(variable)) {
-      // If there's no CI for the variable, create one.
-      if (!variable_to_ci.contains(variable)) {
-        aig_input_variables.push_back(variable);
-        variable_to_ci[variable] = abc::Aig_ObjCreateCi(aig_man);
+      if (system == InterpolationSystem::MCMILLAN) {
+        proofnode_to_aig_node[proofnode] = abc::Aig_And(aig_man, left_node, right_node);
+      } else if (system == InterpolationSystem::MCMILLAN_DUAL) {
+        proofnode_to_aig_node[proofnode] = abc::Aig_Or(aig_man, left_node, right_node);
+      } else {
+        // Create an ITE node.
+        auto variable_node = input_node(variable, variable_to_ci, aig_input_variables);
+        auto new_node = abc::Aig_Mux(aig_man, abc::Aig_NotCond(variable_node, proofnode->label > 0), left_node, right_node);
+        //abc::Aig_ObjPrint(aig_man, left_node);
+        //abc::Aig_ObjPrint(aig_man, right_node);
+        //abc::Aig_ObjPrint(aig_man, new_node);
+        proofnode_to_aig_node[proofnode] = new_node;
       }
-      // Create an ITE node.
-      auto variable_node = variable_to_ci.at(variable);
-      auto new_node = abc::Aig_Mux(aig_man, abc::Aig_NotCond(variable_node, proofnode->label > 0), left_node, right_node);
-      //abc::Aig_ObjPrint(aig_man, left_node);
-      //abc::Aig_ObjPrint(aig_man, right_node);
-      //abc::Aig_ObjPrint(aig_man, new_node);
-      proofnode_to_aig_node[proofnode] = new_node;
     } else if (first_part_variables_set.contains(variable)) {
       // If the variable is local to the first part, create an OR node.
       proofnode_to_aig_node[proofnode] = abc::Aig_Or(aig_man, left_node, right_node);
@@ -310,14 +902,12 @@ void definability_interpolator::process_node(const std::shared_ptr<binary_proofn
   }
 }
 
-std::vector<int> definability_interpolator::construct_aig(const std::vector<int>& shared_variables) {
+std::vector<int> definability_interpolator::construct_aig(const std::shared_ptr<binary_proofnode>& rootnode, const std::vector<int>& shared_variables, InterpolationSystem system) {
   std::unordered_map<std::shared_ptr<binary_proofnode>, abc::Aig_Obj_t*> proofnode_to_aig_node;
   std::unordered_map<int, abc::Aig_Obj_t*> variable_to_ci;
   std::vector<int> aig_input_variables;
   std::unordered_set<int> shared_variables_set(shared_variables.begin(), shared_variables.end());
 
-  assert(clause_id_to_proofnode.contains(empty_id));
-  auto rootnode = clause_id_to_proofnode.at(empty_id);
   assert(rootnode != nullptr);
 
   std::vector<std::shared_ptr<binary_proofnode>> stack;
@@ -345,7 +935,7 @@ std::vector<int> definability_interpolator::construct_aig(const std::vector<int>
       }
     } else {
       // If both child nodes are processed (or don't exist), we can process this node.
-      process_node(node, proofnode_to_aig_node, variable_to_ci, aig_input_variables, shared_variables_set);
+      process_node(node, system, proofnode_to_aig_node, variable_to_ci, aig_input_variables, shared_variables_set);
       processed_nodes.push_back(node);
       node->flag = true;
     }
@@ -369,7 +959,7 @@ void definability_interpolator::delete_clauses() {
 void definability_interpolator::delete_clause(int64_t id) {
   //std::cout << "Deleting clause " << id << std::endl;
   clause_id_to_antecedents.erase(id);
-  clause_id_to_clause.erase(id);
+  clauses.erase(id);
   clause_id_to_proofnode.erase(id);
 }
 
@@ -2,10 +2,18 @@
 #define DEFINABILITY_INTERPOLATOR_HPP
 
 #include "tracer.hpp"
+#include "clause_store.hpp"
+#include "cnf.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <unordered_set>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <tuple>
 
@@ -15,6 +23,18 @@
 
 namespace definability_interpolation {
 
+// Labelled interpolation systems, distinguished by how they treat pivots on shared variables and leaves:
+// PUDLAK (symmetric) uses a multiplexer for shared pivots and constant leaves,
+// MCMILLAN uses an AND for shared pivots and the shared literals of first-part leaves,
+// MCMILLAN_DUAL uses an OR for shared pivots and the negated shared literals of second-part leaves.
+// SMALLEST builds all of them and keeps the one with the fewest AIG nodes.
+enum class InterpolationSystem {
+  PUDLAK,
+  MCMILLAN,
+  MCMILLAN_DUAL,
+  SMALLEST
+};
+
 class definability_interpolator : public CaDiCaL::Tracer
 {
  public:
@@ -40,10 +60,23 @@ class definability_interpolator : public CaDiCaL::Tracer
   // or return a trivial interpolant if the formula for the definability check itself is unsatisfiable.
   void conclude_unsat(CaDiCaL::ConclusionType type, const std::vector<int64_t>& clause_ids) override;
 
-  std::pair<int, std::vector<std::vector<int>>> get_interpolant_clauses(const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig);
+  // Returns the output literal of the interpolant together with its clauses.
+  // With compact_encoding, gates are recognized and encoded polarity-aware instead of node-by-node.
+  std::pair<int, cnf> get_interpolant_clauses(const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig, InterpolationSystem system = InterpolationSystem::PUDLAK, bool compact_encoding = false);
+
+  // Pipelined interpolation: copies the part of the current refutation that is not yet covered by proofnodes and
+  // builds the interpolant on a background thread, so that the solver can continue with the next check.
+  // Interpolants are returned by next_interpolant in submission order.
+  void submit_interpolant(const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig, InterpolationSystem system = InterpolationSystem::PUDLAK, bool compact_encoding = false);
+  std::pair<int, cnf> next_interpolant();
+  size_t pending_interpolants() const;
 
   void delete_clauses();
 
+  // Number of threads building the proofnodes of a refutation for get_interpolant_clauses.
+  // Clauses of the core at the same depth are resolved concurrently; the proof DAG is the same as with one thread.
+  void set_proofnode_threads(size_t threads) { proofnode_threads = std::max<size_t>(threads, 1); }
+
  private:
   // Proofnodes represent (binary) resolvents in the proof DAG.
   // The label is the literal that is resolved upon, and the left and right children are the antecedents.
@@ -71,29 +104,104 @@ class definability_interpolator : public CaDiCaL::Tracer
     }
   };
 
+  // Literals seen while resolving antecedents. Every thread constructing proofnodes has its own.
+  struct marking_scratch {
+    std::vector<int> history;
+    std::unordered_map<int, uint8_t> marks;
+    uint8_t mark_literal(int literal);
+    void unmark_all();
+  };
+
+  // Streams literals of a clause copied out of a clause store, like clause_store::decoder.
+  class literal_decoder {
+   public:
+    explicit literal_decoder(const std::vector<int>& literals) : position(literals.data()), end(literals.data() + literals.size()) {}
+    bool next(int& literal) {
+      if (position == end) {
+        return false;
+      }
+      literal = *position++;
+      return true;
+    }
+
+   private:
+    const int* position;
+    const int* end;
+  };
+
+  // Copy of the proof segment of a refutation, taken on the solver thread.
+  // Antecedents outside the segment contribute their existing proofnodes.
+  struct interpolation_job {
+    int64_t empty_id;
+    std::vector<int64_t> core;
+    std::unordered_map<int64_t, std::vector<int64_t>> antecedents;
+    std::unordered_map<int64_t, std::vector<int>> literals;
+    std::unordered_map<int64_t, std::shared_ptr<binary_proofnode>> proofnodes;
+    std::vector<int> shared_variables;
+    int auxiliary_variable_start;
+    bool rewrite_aig;
+    InterpolationSystem system;
+    bool compact_encoding;
+  };
+
+  struct interpolation_result {
+    std::pair<int, cnf> interpolant;
+    // Proofnodes built for the segment, merged into clause_id_to_proofnode when the result is taken.
+    std::vector<std::pair<int64_t, std::shared_ptr<binary_proofnode>>> proofnodes;
+    std::exception_ptr error;
+  };
+
+  template <typename ProofnodeOf, typename DecoderOf>
+  static std::shared_ptr<binary_proofnode> resolve_antecedents(const std::vector<int64_t>& antecedents, ProofnodeOf proofnode_of, DecoderOf decoder_of, marking_scratch& marking);
+
   std::vector<int64_t> get_core() const;
-  uint8_t mark_literal(int literal);
-  void unmark_all();
+  clause_store::decoder decode_clause(int64_t id) const;
   void create_derived_proofnode(int64_t id);
   void create_core_proofnodes();
-  void process_node(const std::shared_ptr<binary_proofnode>& proofnode, std::unordered_map<std::shared_ptr<binary_proofnode>, abc::Aig_Obj_t*>& proofnode_to_aig_node, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables, std::unordered_set<int>& shared_variables_set);
-  std::vector<int> construct_aig(const std::vector<int>& shared_variables);
+  void create_core_proofnodes_parallel(const std::vector<int64_t>& core);
+  std::pair<int, cnf> interpolate(const std::shared_ptr<binary_proofnode>& rootnode, const std::vector<int>& shared_variables, int auxiliary_variable_start, bool rewrite_aig, InterpolationSystem system, bool compact_encoding);
+  void run_worker();
+  void wait_for_worker();
+  abc::Aig_Obj_t* input_node(int variable, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables);
+  abc::Aig_Obj_t* leaf_node(const std::shared_ptr<binary_proofnode>& proofnode, InterpolationSystem system, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables, std::unordered_set<int>& shared_variables_set);
+  void process_node(const std::shared_ptr<binary_proofnode>& proofnode, InterpolationSystem system, std::unordered_map<std::shared_ptr<binary_proofnode>, abc::Aig_Obj_t*>& proofnode_to_aig_node, std::unordered_map<int, abc::Aig_Obj_t*>& variable_to_ci, std::vector<int>& aig_input_variables, std::unordered_set<int>& shared_variables_set);
+  std::vector<int> construct_aig(const std::shared_ptr<binary_proofnode>& rootnode, const std::vector<int>& shared_variables, InterpolationSystem system);
+  int encode_aig_tseitin(int auxiliary_variable_start, cnf& interpolant_clauses);
+  int encode_aig_compact(int auxiliary_variable_start, cnf& interpolant_clauses);
   void clear_proofnodes();
   void delete_clause(int64_t id);
 
   int64_t empty_id;
   std::unordered_set<int> first_part_variables_set;
   std::unordered_map<int64_t, std::vector<int64_t>> clause_id_to_antecedents;
-  std::unordered_map<int64_t, std::vector<int>> clause_id_to_clause;
+  // Original clauses are only added while no interpolation runs in the background, so the worker may read them.
+  // Derived clauses arrive during solving and are only accessed from the solver thread.
+  clause_store original_clauses;
+  clause_store clauses;
   std::unordered_map<int64_t, std::shared_ptr<binary_proofnode>> clause_id_to_proofnode;
+  // Original clause behind each leaf, needed by systems whose leaf interpolants are not constant.
+  std::unordered_map<const binary_proofnode*, int64_t> leaf_to_clause_id;
 
   std::vector<int64_t> delete_ids;
   std::unordered_map<int64_t, std::shared_ptr<clause_derivation_node>> clause_id_to_derivation_node;
   
-  std::vector<int> marking_history;
-  std::unordered_map<int, uint8_t> marks;
+  marking_scratch marking;
+  size_t proofnode_threads = 1;
 
+  // Owned by whichever thread interpolates: the worker while jobs are pending, the solver thread otherwise.
   abc::Aig_Man_t* aig_man;
+
+  std::thread worker;
+  mutable std::mutex worker_mutex;
+  std::condition_variable worker_condition;
+  std::deque<interpolation_job> jobs;
+  std::deque<interpolation_result> results;
+  size_t nr_pending = 0; // Submitted but not yet returned by next_interpolant.
+  bool worker_busy = false;
+  bool worker_stop = false;
+  // Only accessed by the worker thread.
+  marking_scratch worker_marking;
+  std::unordered_map<int64_t, std::shared_ptr<binary_proofnode>> worker_proofnodes;
 };
 
 } // namespace definability_interpolation
@@ -1,6 +1,8 @@
 #include "definition_extractor.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <stdexcept>
 
 namespace definability_interpolation {
 
@@ -8,14 +10,17 @@ definition_extractor::definition_extractor() : state(State::UNDEFINED), interpol
 
 void definition_extractor::add_variable(int variable) {
   assert(variable > 0);
-  while (variable >= equality_selector.size()) {
-    equality_selector.push_back(0);
+  if (variable >= equality_selector.size()) {
+    equality_selector.resize(variable + 1, 0);
   }
   auto equal_selector = 3 * variable + 2;
   equality_selector[variable] = equal_selector;
   auto first_part_variable = translate_literal(variable, true);
   auto second_part_variable = translate_literal(variable, false);
-  solver.append_formula({{-equal_selector, first_part_variable, -second_part_variable}, {-equal_selector, -first_part_variable, second_part_variable}});
+  clause_buffer.assign({-equal_selector, first_part_variable, -second_part_variable});
+  solver.add_clause(clause_buffer);
+  clause_buffer.assign({-equal_selector, -first_part_variable, second_part_variable});
+  solver.add_clause(clause_buffer);
 }
 
 int definition_extractor::translate_literal(int literal, bool first_part) {
@@ -24,13 +29,13 @@ int definition_extractor::translate_literal(int literal, bool first_part) {
   return literal < 0 ? -v_translated : v_translated;
 }
 
-int definition_extractor::original_literal(int translated_literal) {
+int definition_extractor::original_literal(int translated_literal, int auxiliary_start) {
   auto v = abs(translated_literal);
-  auto v_original = v / 3;
-  if (v_original >= equality_selector.size()) {
+  if (v >= auxiliary_start) {
     // This is an auxiliary variable introduced during interpolation.
     return translated_literal;
   }
+  auto v_original = v / 3;
   return translated_literal < 0 ? -v_original : v_original;
 }
 
@@ -42,35 +47,103 @@ std::vector<int> definition_extractor::translate_clause(const std::vector<int>&
   return translated_clause;
 }
 
-void definition_extractor::original_clause(std::vector<int>& translated_clause) {
+void definition_extractor::original_clause(std::span<int> translated_clause, int auxiliary_start) {
   for (auto& l: translated_clause) {
-    l = original_literal(l);
+    l = original_literal(l, auxiliary_start);
   }
 }
 
-void definition_extractor::add_clause(const std::vector<int>& clause) {
+void definition_extractor::add_clause(std::span<const int> clause) {
   state = State::UNDEFINED;
+  // Definitions remain valid for a stronger formula, but undefined variables may become defined.
+  cache.clear_undefined();
   for (auto l: clause) {
     auto v = abs(l);
     if (v >= equality_selector.size() or equality_selector[v] == 0) {
       add_variable(v);
     }
   }
-  auto first_part_clause = translate_clause(clause, true);
-  first_part_clause.push_back(1);
-  solver.add_clause(first_part_clause);
-  solver.add_clause(translate_clause(clause, false));
+  add_clause_copies(clause);
+}
+
+// Both copies are translated into the same buffer, the first one is marked with literal 1.
+void definition_extractor::add_clause_copies(std::span<const int> clause) {
+  clause_buffer.clear();
+  for (auto l: clause) {
+    clause_buffer.push_back(translate_literal(l, true));
+  }
+  clause_buffer.push_back(1);
+  solver.add_clause(clause_buffer);
+  clause_buffer.clear();
+  for (auto l: clause) {
+    clause_buffer.push_back(translate_literal(l, false));
+  }
+  solver.add_clause(clause_buffer);
 }
 
-void definition_extractor::append_formula(const std::vector<std::vector<int>>& formula) {
-  for (const auto& clause: formula) {
-    add_clause(clause);
+void definition_extractor::append_formula(const cnf& formula, int num_variables) {
+  state = State::UNDEFINED;
+  cache.clear_undefined();
+  // Size the variable table once and add the selector clauses of all new variables before the clauses themselves,
+  // so that the clauses can be streamed without checking their variables.
+  int max_variable = std::max(num_variables, static_cast<int>(equality_selector.size()) - 1);
+  for (auto l: formula.all_literals()) {
+    max_variable = std::max(max_variable, abs(l));
+  }
+  std::vector<bool> occurs(max_variable + 1, false);
+  for (auto l: formula.all_literals()) {
+    occurs[abs(l)] = true;
+  }
+  equality_selector.resize(max_variable + 1, 0);
+  for (int v = 1; v <= max_variable; v++) {
+    if (occurs[v] && equality_selector[v] == 0) {
+      add_variable(v);
+    }
+  }
+  for (auto clause: formula) {
+    add_clause_copies(clause);
   }
 }
 
 bool definition_extractor::has_definition(int variable, const std::vector<int>& shared_variables, const std::vector<int>& assumptions) {
   assert(variable > 0);
   state = State::UNDEFINED;
+  // Assumptions change the formula, so only checks without them are cached.
+  last_cacheable = cache_enabled && assumptions.empty();
+  last_from_cache = false;
+  if (last_cacheable) {
+    last_cache_key = shared_variables;
+    std::sort(last_cache_key.begin(), last_cache_key.end());
+    last_cache_key.erase(std::unique(last_cache_key.begin(), last_cache_key.end()), last_cache_key.end());
+    for (auto v: last_cache_key) {
+      if (v >= equality_selector.size() or equality_selector[v] == 0) {
+        add_variable(v);
+      }
+    }
+    if (cache.known_undefined(variable, last_cache_key)) {
+      return false;
+    }
+    if (cache.known_defined(variable, last_cache_key)) {
+      state = State::DEFINED;
+      last_shared_variables = shared_variables;
+      last_variable = variable;
+      last_from_cache = true;
+      return true;
+    }
+  }
+  bool has_definition = solve_definability(variable, shared_variables, assumptions);
+  if (last_cacheable) {
+    if (has_definition) {
+      cache.insert_defined(variable, last_cache_key);
+    } else {
+      cache.insert_undefined(variable, last_cache_key);
+    }
+  }
+  return has_definition;
+}
+
+bool definition_extractor::solve_definability(int variable, const std::vector<int>& shared_variables, const std::vector<int>& assumptions) {
+  nr_solver_calls++;
   std::vector<int> assumptions_internal;
   for (auto v: shared_variables) {
     if (v >= equality_selector.size() or equality_selector[v] == 0) {
@@ -98,19 +171,97 @@ bool definition_extractor::has_definition(int variable, const std::vector<int>&
   return has_definition;
 }
 
-std::pair<std::vector<std::vector<int>>, int> definition_extractor::get_definition(bool rewrite) {
+std::pair<cnf, int> definition_extractor::get_definition(bool rewrite, InterpolationSystem system, bool compact_encoding) {
   if (state != State::DEFINED) {
     throw UndefinedException();
   }
   state = State::UNDEFINED; // Can we make sure that repeated calls of get_definition are safe?
-  auto [output_variable, definition] = interpolator.get_interpolant_clauses(translate_clause(last_shared_variables, true), 3 * equality_selector.size(), rewrite);
+  int auxiliary_start = 3 * equality_selector.size();
+  if (auto definition = cached_definition(rewrite, system, compact_encoding, auxiliary_start)) {
+    return std::make_pair(*definition, auxiliary_start);
+  }
+  auxiliary_start = prepare_interpolation();
+  auto [output_variable, definition] = interpolator.get_interpolant_clauses(translate_clause(last_shared_variables, true), auxiliary_start, rewrite, system, compact_encoding);
   interpolator.delete_clauses();
-  for (auto& clause: definition) {
-    original_clause(clause);
+  finish_definition(last_variable, output_variable, definition, auxiliary_start);
+  if (last_cacheable && cache_definitions) {
+    cache.store_definition(last_variable, last_cache_key, {definition, auxiliary_start, rewrite, system, compact_encoding});
   }
-  definition.push_back({ output_variable, -last_variable});
-  definition.push_back({-output_variable,  last_variable});
-  return std::make_pair(definition, 3 * equality_selector.size());
+  return std::make_pair(definition, auxiliary_start);
+}
+
+void definition_extractor::queue_definition(bool rewrite, InterpolationSystem system, bool compact_encoding) {
+  if (state != State::DEFINED) {
+    throw UndefinedException();
+  }
+  state = State::UNDEFINED;
+  int auxiliary_start = 3 * equality_selector.size();
+  queued_definition entry{last_variable, last_cacheable && cache_definitions, last_cache_key, auxiliary_start, rewrite, system, compact_encoding,
+    cached_definition(rewrite, system, compact_encoding, auxiliary_start)};
+  if (!entry.cached) {
+    entry.auxiliary_start = prepare_interpolation();
+    interpolator.submit_interpolant(translate_clause(last_shared_variables, true), entry.auxiliary_start, rewrite, system, compact_encoding);
+    interpolator.delete_clauses();
+  }
+  queued.push_back(std::move(entry));
+}
+
+std::tuple<int, cnf, int> definition_extractor::next_definition() {
+  if (queued.empty()) {
+    throw std::logic_error("no queued definition");
+  }
+  auto entry = std::move(queued.front());
+  queued.pop_front();
+  if (entry.cached) {
+    return std::make_tuple(entry.variable, std::move(*entry.cached), entry.auxiliary_start);
+  }
+  auto [output_variable, definition] = interpolator.next_interpolant();
+  finish_definition(entry.variable, output_variable, definition, entry.auxiliary_start);
+  if (entry.cacheable) {
+    cache.store_definition(entry.variable, entry.cache_key, {definition, entry.auxiliary_start, entry.rewrite, entry.system, entry.compact_encoding});
+  }
+  return std::make_tuple(entry.variable, std::move(definition), entry.auxiliary_start);
+}
+
+// If the last check was answered from the cache, look for a stored definition over a subset of the shared variables
+// and move its auxiliary variables to the current base.
+std::optional<cnf> definition_extractor::cached_definition(bool rewrite, InterpolationSystem system, bool compact_encoding, int auxiliary_start) {
+  if (!last_from_cache) {
+    return std::nullopt;
+  }
+  auto cached = cache.find_definition(last_variable, last_cache_key, rewrite, system, compact_encoding);
+  if (!cached) {
+    return std::nullopt;
+  }
+  auto definition = cached->clauses;
+  for (auto& l: definition.all_literals()) {
+    auto v = abs(l);
+    if (v >= cached->auxiliary_start) {
+      v = v - cached->auxiliary_start + auxiliary_start;
+      l = l < 0 ? -v : v;
+    }
+  }
+  return definition;
+}
+
+// Make sure the interpolator holds a refutation for the last check, returns the first auxiliary variable.
+int definition_extractor::prepare_interpolation() {
+  if (last_from_cache) {
+    // Only the answer was cached, the proof is needed for interpolation.
+    [[maybe_unused]] auto defined = solve_definability(last_variable, last_shared_variables, {});
+    assert(defined);
+    state = State::UNDEFINED;
+    last_from_cache = false;
+  }
+  return 3 * equality_selector.size();
+}
+
+void definition_extractor::finish_definition(int variable, int output_variable, cnf& definition, int auxiliary_start) {
+  original_clause(definition.all_literals(), auxiliary_start);
+  // The output is a shared literal if the interpolant is one.
+  output_variable = original_literal(output_variable, auxiliary_start);
+  definition.add_clause({ output_variable, -variable});
+  definition.add_clause({-output_variable,  variable});
 }
 
 } // namespace definability_interpolation
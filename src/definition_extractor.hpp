@@ -1,9 +1,14 @@
 #ifndef DEFINITION_EXTRACTOR_HPP
 #define DEFINITION_EXTRACTOR_HPP
 
+#include "definability_cache.hpp"
 #include "definability_interpolator.hpp"
 #include "cadical_solver.hpp"
 
+#include <deque>
+#include <optional>
+#include <span>
+#include <tuple>
 #include <vector>
 #include <utility>
 
@@ -20,10 +25,31 @@ class UndefinedException : public std::exception {
 class definition_extractor {
  public:
   definition_extractor();
-  void add_clause(const std::vector<int>& clause);
-  void append_formula(const std::vector<std::vector<int>>& formula);
+  void add_clause(std::span<const int> clause);
+  // Bulk alternative to add_clause. num_variables, e.g. from the QDIMACS header, sizes the variable table up front.
+  void append_formula(const cnf& formula, int num_variables = 0);
   bool has_definition(int variable, const std::vector<int>& shared_variables, const std::vector<int>& assumptions);
-  std::pair<std::vector<std::vector<int>>, int> get_definition(bool rewrite);
+  std::pair<cnf, int> get_definition(bool rewrite, InterpolationSystem system = InterpolationSystem::PUDLAK, bool compact_encoding = false);
+  // Pipelined alternative to get_definition: the definition of the last defined variable is built in the background
+  // while further checks run. Queued definitions come out of next_definition in queue order, as
+  // (variable, definition clauses, first auxiliary variable).
+  void queue_definition(bool rewrite, InterpolationSystem system = InterpolationSystem::PUDLAK, bool compact_encoding = false);
+  std::tuple<int, cnf, int> next_definition();
+  size_t queued_definitions() const { return queued.size(); }
+  // Number of definability checks that called the solver (checks without assumptions may be answered from the cache).
+  size_t solver_calls() const { return nr_solver_calls; }
+  // Off by default. When on, checks without assumptions are answered from earlier checks of the same variable over
+  // subsets or supersets of the shared variables, which pays off when variables are checked repeatedly (e.g. in a
+  // retry pass). Definitions are only kept for reuse with keep_definitions. Turning the cache off empties it.
+  void set_cache(bool enabled, bool keep_definitions = false) {
+    cache_enabled = enabled;
+    cache_definitions = enabled && keep_definitions;
+    if (!enabled) {
+      cache.clear();
+    }
+  }
+  // Threads used to build the proof DAG of a refutation in get_definition.
+  void set_proofnode_threads(size_t threads) { interpolator.set_proofnode_threads(threads); }
 
  protected:
   enum class State {
@@ -34,16 +60,44 @@ class definition_extractor {
   State state;
   void add_variable(int variable);
   int translate_literal(int literal, bool first_part);
-  int original_literal(int translated_literal);
+  int original_literal(int translated_literal, int auxiliary_start);
   std::vector<int> translate_clause(const std::vector<int>& clause, bool first_part);
-  void original_clause(std::vector<int>& translated_clause);
+  void original_clause(std::span<int> translated_clause, int auxiliary_start);
+  void add_clause_copies(std::span<const int> clause);
+  bool solve_definability(int variable, const std::vector<int>& shared_variables, const std::vector<int>& assumptions);
+  std::optional<cnf> cached_definition(bool rewrite, InterpolationSystem system, bool compact_encoding, int auxiliary_start);
+  int prepare_interpolation();
+  void finish_definition(int variable, int output_variable, cnf& definition, int auxiliary_start);
+
+  // A definition handed to the interpolator's worker, or one taken from the cache.
+  struct queued_definition {
+    int variable;
+    bool cacheable; // The definition is kept in the cache once built.
+    std::vector<int> cache_key;
+    int auxiliary_start;
+    bool rewrite;
+    InterpolationSystem system;
+    bool compact_encoding;
+    std::optional<cnf> cached;
+  };
 
   definability_interpolation::definability_interpolator interpolator;
   cadical_interface::Cadical solver;
   
   std::vector<int> equality_selector;
+  std::vector<int> clause_buffer; // Reused for every clause handed to the solver.
   std::vector<int> last_shared_variables;
   int last_variable;
+
+  definability_cache cache;
+  bool cache_enabled = false;
+  bool cache_definitions = false;
+  bool last_cacheable = false;       // The last check had no assumptions.
+  std::vector<int> last_cache_key;   // Sorted shared variables of the last check.
+  bool last_from_cache = false;      // The solver was not called, get_definition has to solve again.
+  size_t nr_solver_calls = 0;
+
+  std::deque<queued_definition> queued;
 };
 
 } // namespace definability_interpolation
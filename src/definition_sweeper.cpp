@@ -0,0 +1,375 @@
+#include "definition_sweeper.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <unordered_set>
+
+namespace definability_interpolation {
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Universals in prefix order, followed by existentials sorted by key (ties broken by prefix order).
+std::vector<size_t> universals_then_existentials_by(const std::vector<bool>& is_existential, const std::vector<size_t>& key) {
+  std::vector<size_t> order;
+  std::vector<size_t> existentials;
+  for (size_t i = 0; i < is_existential.size(); i++) {
+    if (is_existential[i]) {
+      existentials.push_back(i);
+    } else {
+      order.push_back(i);
+    }
+  }
+  std::stable_sort(existentials.begin(), existentials.end(), [&key](size_t a, size_t b) { return key[a] < key[b]; });
+  order.insert(order.end(), existentials.begin(), existentials.end());
+  return order;
+}
+
+} // namespace
+
+std::vector<size_t> prefix_ordering::order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const {
+  std::vector<size_t> order(variables.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (reversed) {
+    std::reverse(order.begin(), order.end());
+  }
+  return order;
+}
+
+std::vector<size_t> occurrence_ordering::order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const {
+  std::unordered_map<int, size_t> occurrences;
+  for (auto l: clauses.all_literals()) {
+    occurrences[std::abs(l)]++;
+  }
+  std::vector<size_t> key(variables.size());
+  for (size_t i = 0; i < variables.size(); i++) {
+    auto it = occurrences.find(variables[i]);
+    key[i] = it == occurrences.end() ? 0 : it->second;
+  }
+  return universals_then_existentials_by(is_existential, key);
+}
+
+std::vector<size_t> dependency_ordering::order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const {
+  std::unordered_map<int, std::vector<size_t>> variable_to_clauses;
+  for (size_t c = 0; c < clauses.size(); c++) {
+    for (auto l: clauses[c]) {
+      variable_to_clauses[std::abs(l)].push_back(c);
+    }
+  }
+  // Breadth-first search from the universals, alternating between variables and clauses.
+  std::unordered_map<int, size_t> depth;
+  std::vector<bool> clause_seen(clauses.size(), false);
+  std::vector<int> queue;
+  for (size_t i = 0; i < variables.size(); i++) {
+    if (!is_existential[i] && depth.emplace(variables[i], 0).second) {
+      queue.push_back(variables[i]);
+    }
+  }
+  for (size_t k = 0; k < queue.size(); k++) {
+    auto v = queue[k];
+    auto it = variable_to_clauses.find(v);
+    if (it == variable_to_clauses.end()) {
+      continue;
+    }
+    for (auto c: it->second) {
+      if (clause_seen[c]) {
+        continue;
+      }
+      clause_seen[c] = true;
+      for (auto l: clauses[c]) {
+        if (depth.emplace(std::abs(l), depth.at(v) + 1).second) {
+          queue.push_back(std::abs(l));
+        }
+      }
+    }
+  }
+  std::vector<size_t> key(variables.size());
+  for (size_t i = 0; i < variables.size(); i++) {
+    auto it = depth.find(variables[i]);
+    key[i] = it == depth.end() ? std::numeric_limits<size_t>::max() : it->second;
+  }
+  return universals_then_existentials_by(is_existential, key);
+}
+
+void definition_pool::publish(int variable, std::vector<int> support, const cnf& definition_clauses, int auxiliary_start) {
+  std::lock_guard<std::mutex> lock(mutex);
+  definitions.try_emplace(variable, entry{std::move(support), definition_clauses, auxiliary_start});
+}
+
+bool definition_pool::adopt(int variable, const std::function<bool(int)>& allowed, cnf& definition_clauses, int& auxiliary_start) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = definitions.find(variable);
+  if (it == definitions.end() || !std::all_of(it->second.support.begin(), it->second.support.end(), allowed)) {
+    return false;
+  }
+  definition_clauses = it->second.clauses;
+  auxiliary_start = it->second.auxiliary_start;
+  return true;
+}
+
+definition_sweeper::definition_sweeper(definition_extractor& extractor, int num_variables, const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses)
+  : extractor(extractor), num_variables(num_variables), variables(variables), is_existential(is_existential), clauses(clauses) {}
+
+std::vector<int> definition_sweeper::definition_support(const cnf& definition_clauses, int variable, int num_variables) {
+  std::vector<int> support;
+  for (int lit : definition_clauses.all_literals()) {
+    int var = abs(lit);
+    if (var != variable && var <= num_variables) {
+      support.push_back(var);
+    }
+  }
+  std::sort(support.begin(), support.end());
+  support.erase(std::unique(support.begin(), support.end()), support.end());
+  return support;
+}
+
+bool definition_sweeper::should_stop(const sweep_options& options, const sweep_statistics& statistics) const {
+  return (options.stop && options.stop->load(std::memory_order_relaxed)) || (options.target > 0 && statistics.nr_defined >= options.target);
+}
+
+sweep_statistics definition_sweeper::run(const variable_ordering& ordering, SweepMode mode, const sweep_options& options) {
+  auto start = std::chrono::steady_clock::now();
+  sweep_statistics statistics;
+  statistics.strategy = ordering.name() + (mode == SweepMode::FORWARD ? "/forward" : mode == SweepMode::FORWARD_STRICT ? "/forward-strict" : "/transitive");
+  auto order = ordering.order(variables, is_existential, clauses);
+  pending.clear();
+  if (mode == SweepMode::TRANSITIVE) {
+    run_transitive(order, options, statistics);
+  } else {
+    run_forward(order, mode == SweepMode::FORWARD_STRICT, options, statistics);
+  }
+  statistics.total_seconds = seconds_since(start);
+  return statistics;
+}
+
+// Check y (or adopt a definition from the pool) and queue its definition for reporting.
+bool definition_sweeper::define_variable(int y, const std::vector<int>& defining_variables, const std::function<bool(int)>& allowed, const sweep_options& options, sweep_statistics& statistics,
+                                         double earlier_sat_seconds, double earlier_interpolation_seconds) {
+  cnf definition_clauses;
+  int aux_start;
+  if (options.pool && options.pool->adopt(y, allowed, definition_clauses, aux_start)) {
+    statistics.nr_shared++;
+    pending.push_back({y, std::make_pair(std::move(definition_clauses), aux_start), true, earlier_sat_seconds, earlier_interpolation_seconds});
+  } else {
+    auto sat_start = std::chrono::steady_clock::now();
+    auto solver_calls = extractor.solver_calls();
+    bool defined = extractor.has_definition(y, defining_variables, {});
+    statistics.sat_calls += extractor.solver_calls() - solver_calls;
+    auto sat_seconds = seconds_since(sat_start);
+    statistics.sat_seconds += sat_seconds;
+    if (!defined) {
+      if (options.on_check) {
+        options.on_check({y, false, false, earlier_sat_seconds + sat_seconds, earlier_interpolation_seconds, 0});
+      }
+      return false;
+    }
+    if (options.pipeline_depth > 0) {
+      solver_calls = extractor.solver_calls();
+      extractor.queue_definition(options.rewrite, options.system, options.compact_encoding);
+      statistics.sat_calls += extractor.solver_calls() - solver_calls;
+      pending.push_back({y, std::nullopt, false, earlier_sat_seconds + sat_seconds, earlier_interpolation_seconds});
+    } else {
+      auto interpolation_start = std::chrono::steady_clock::now();
+      solver_calls = extractor.solver_calls();
+      std::tie(definition_clauses, aux_start) = extractor.get_definition(options.rewrite, options.system, options.compact_encoding);
+      statistics.sat_calls += extractor.solver_calls() - solver_calls;
+      auto interpolation_seconds = seconds_since(interpolation_start);
+      statistics.interpolation_seconds += interpolation_seconds;
+      pending.push_back({y, std::make_pair(std::move(definition_clauses), aux_start), false, earlier_sat_seconds + sat_seconds, earlier_interpolation_seconds + interpolation_seconds});
+    }
+  }
+  statistics.nr_defined++;
+  return true;
+}
+
+std::pair<cnf, int> definition_sweeper::take_definition(pending_definition& definition, sweep_statistics& statistics) {
+  if (definition.clauses) {
+    return std::move(*definition.clauses);
+  }
+  // Only the time spent waiting for the worker is counted.
+  auto interpolation_start = std::chrono::steady_clock::now();
+  auto [variable, definition_clauses, aux_start] = extractor.next_definition();
+  assert(variable == definition.variable);
+  auto interpolation_seconds = seconds_since(interpolation_start);
+  definition.interpolation_seconds += interpolation_seconds;
+  statistics.interpolation_seconds += interpolation_seconds;
+  return std::make_pair(std::move(definition_clauses), aux_start);
+}
+
+// Publish and report a definition, returns its support.
+std::vector<int> definition_sweeper::report_definition(const pending_definition& definition, cnf& definition_clauses, int aux_start, const sweep_options& options, sweep_statistics& statistics) {
+  auto variable = definition.variable;
+  statistics.total_definition_clauses += definition_clauses.size();
+  if (options.on_check) {
+    options.on_check({variable, true, definition.shared, definition.sat_seconds, definition.interpolation_seconds, definition_clauses.size()});
+  }
+  auto support = definition_support(definition_clauses, variable, num_variables);
+  if (options.pool) {
+    options.pool->publish(variable, support, definition_clauses, aux_start);
+  }
+  if (options.on_definition) {
+    options.on_definition(variable, definition_clauses, aux_start);
+  }
+  return support;
+}
+
+std::vector<std::pair<int, std::vector<int>>> definition_sweeper::settle(size_t keep, const sweep_options& options, sweep_statistics& statistics) {
+  std::vector<std::pair<int, std::vector<int>>> reported;
+  while (pending.size() > keep) {
+    auto definition = std::move(pending.front());
+    pending.pop_front();
+    auto [definition_clauses, aux_start] = take_definition(definition, statistics);
+    reported.emplace_back(definition.variable, report_definition(definition, definition_clauses, aux_start, options, statistics));
+  }
+  return reported;
+}
+
+// Accumulate defining variables in the order of processing.
+void definition_sweeper::run_forward(const std::vector<size_t>& order, bool strict, const sweep_options& options, sweep_statistics& statistics) {
+  std::vector<int> defining_variables;
+  std::unordered_set<int> defining_set;
+  auto allowed = [&defining_set](int v) { return defining_set.count(v) > 0; };
+  for (auto i: order) {
+    if (should_stop(options, statistics)) {
+      statistics.stopped = true;
+      break;
+    }
+    auto v = variables[i];
+    bool defined = false;
+    if (is_existential[i]) {
+      statistics.nr_existential++;
+      if (!options.eligible || options.eligible(v)) {
+        if (options.on_progress) {
+          options.on_progress();
+        }
+        defined = define_variable(v, defining_variables, allowed, options, statistics);
+        settle(options.pipeline_depth, options, statistics);
+      }
+    }
+    if (!is_existential[i] || !strict || defined) {
+      defining_variables.push_back(v);
+      if (options.pool) {
+        defining_set.insert(v);
+      }
+    }
+  }
+  settle(0, options, statistics);
+}
+
+// Allow everything except variables whose definitions transitively depend on the current one.
+void definition_sweeper::run_transitive(const std::vector<size_t>& order, const sweep_options& options, sweep_statistics& statistics) {
+  std::unordered_set<int> universal_vars;
+  std::unordered_set<int> existential_vars;
+  for (int i = 0; i < variables.size(); i++) {
+    if (is_existential[i]) existential_vars.insert(variables[i]);
+    else universal_vars.insert(variables[i]);
+  }
+
+  // reverse_support[z] = vars whose direct support contains z.
+  std::unordered_map<int, std::vector<int>> reverse_support;
+  auto record_supports = [&reverse_support](const std::vector<std::pair<int, std::vector<int>>>& reported) {
+    for (const auto& [y, support]: reported) {
+      for (int z : support) {
+        reverse_support[z].push_back(y);
+      }
+    }
+  };
+
+  // BFS from y through reverse_support to find all vars that transitively depend on y.
+  auto dependents = [&reverse_support](int y) {
+    std::unordered_set<int> depends_on_y;
+    auto rev_it = reverse_support.find(y);
+    if (rev_it != reverse_support.end()) {
+      std::vector<int> queue(rev_it->second.begin(), rev_it->second.end());
+      depends_on_y.insert(queue.begin(), queue.end());
+      size_t idx = 0;
+      while (idx < queue.size()) {
+        int x = queue[idx++];
+        auto it = reverse_support.find(x);
+        if (it == reverse_support.end()) continue;
+        for (int w : it->second) {
+          if (depends_on_y.insert(w).second) {
+            queue.push_back(w);
+          }
+        }
+      }
+    }
+    return depends_on_y;
+  };
+
+  // At most one definition overlaps with the next check.
+  size_t keep = std::min<size_t>(options.pipeline_depth, 1);
+
+  for (auto i: order) {
+    if (should_stop(options, statistics)) {
+      statistics.stopped = true;
+      break;
+    }
+    auto y = variables[i];
+    if (!is_existential[i]) continue;
+
+    statistics.nr_existential++;
+
+    if (options.eligible && !options.eligible(y)) continue;
+
+    if (options.on_progress) {
+      options.on_progress();
+    }
+
+    auto check = [&](const std::unordered_set<int>& depends_on_y, double earlier_sat_seconds = 0, double earlier_interpolation_seconds = 0) {
+      std::vector<int> defining_variables;
+      for (auto u : universal_vars) {
+        defining_variables.push_back(u);
+      }
+      for (auto e : existential_vars) {
+        if (e == y) continue;
+        if (depends_on_y.count(e)) continue;
+        defining_variables.push_back(e);
+      }
+
+      auto allowed = [&](int v) {
+        return universal_vars.count(v) || (existential_vars.count(v) && v != y && !depends_on_y.count(v));
+      };
+      return define_variable(y, defining_variables, allowed, options, statistics, earlier_sat_seconds, earlier_interpolation_seconds);
+    };
+
+    auto depends_on_y = dependents(y);
+    bool defined = check(depends_on_y);
+    if (keep == 0) {
+      record_supports(settle(0, options, statistics));
+      continue;
+    }
+    // Settle the definition that overlapped with this check. Dependents only grow, so an unchanged count means
+    // the check used exactly the variables it would have used without the overlap.
+    auto reported = settle(defined ? 1 : 0, options, statistics);
+    record_supports(reported);
+    if (!defined || reported.empty()) continue;
+    auto updated = dependents(y);
+    if (updated.size() == depends_on_y.size()) continue;
+    // If the definition of y uses one of the new dependents, it would close a cycle: discard it and check again.
+    auto definition = take_definition(pending.back(), statistics);
+    auto support = definition_support(definition.first, y, num_variables);
+    if (std::none_of(support.begin(), support.end(), [&updated](int v) { return updated.count(v) > 0; })) {
+      pending.back().clauses = std::move(definition);
+      continue;
+    }
+    auto discarded = std::move(pending.back());
+    pending.pop_back();
+    statistics.nr_defined--;
+    if (discarded.shared) {
+      statistics.nr_shared--;
+    }
+    check(updated, discarded.sat_seconds, discarded.interpolation_seconds);
+  }
+  record_supports(settle(0, options, statistics));
+}
+
+} // namespace definability_interpolation
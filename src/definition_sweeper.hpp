@@ -0,0 +1,166 @@
+#ifndef DEFINITION_SWEEPER_HPP
+#define DEFINITION_SWEEPER_HPP
+
+#include "definition_extractor.hpp"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace definability_interpolation {
+
+// Which variables may be used in the support of the variable currently checked.
+enum class SweepMode {
+  FORWARD,        // All variables processed before it.
+  FORWARD_STRICT, // Universals and defined existentials processed before it.
+  TRANSITIVE      // All variables except those whose definitions (transitively) depend on it.
+};
+
+// Order in which a sweep processes the variables of the prefix.
+class variable_ordering {
+ public:
+  virtual ~variable_ordering() = default;
+  virtual std::string name() const = 0;
+  // Returns a permutation of the prefix positions.
+  virtual std::vector<size_t> order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const = 0;
+};
+
+// The order of the QDIMACS prefix, optionally reversed.
+class prefix_ordering : public variable_ordering {
+ public:
+  explicit prefix_ordering(bool reversed = false) : reversed(reversed) {}
+  std::string name() const override { return reversed ? "reverse-prefix" : "prefix"; }
+  std::vector<size_t> order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const override;
+
+ private:
+  bool reversed;
+};
+
+// Universals first, then existentials with the fewest occurrences in the matrix.
+class occurrence_ordering : public variable_ordering {
+ public:
+  std::string name() const override { return "occurrence"; }
+  std::vector<size_t> order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const override;
+};
+
+// Universals first, then existentials by their distance from the universals in the clause/variable incidence graph.
+// Existentials close to the universals tend to be defined by them directly, which makes later checks cheaper.
+class dependency_ordering : public variable_ordering {
+ public:
+  std::string name() const override { return "dependency"; }
+  std::vector<size_t> order(const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses) const override;
+};
+
+// Definitions published by concurrently running sweeps over the same formula.
+// A definition is valid regardless of who found it, so a sweep may adopt it instead of checking the variable
+// itself, as long as the support lies within the variables that sweep would allow.
+class definition_pool {
+ public:
+  void publish(int variable, std::vector<int> support, const cnf& definition_clauses, int auxiliary_start);
+  bool adopt(int variable, const std::function<bool(int)>& allowed, cnf& definition_clauses, int& auxiliary_start);
+
+ private:
+  struct entry {
+    std::vector<int> support;
+    cnf clauses;
+    int auxiliary_start;
+  };
+  std::mutex mutex;
+  std::unordered_map<int, entry> definitions;
+};
+
+// Outcome of checking one variable, reported once the outcome is final (for defined variables, once the definition
+// has been built). Times cover all checks of the variable, including a check the transitive sweep repeats after
+// discarding its definition; with pipelining, interpolation time is the time spent waiting for the definition.
+struct check_event {
+  int variable;
+  bool defined;
+  bool shared; // Adopted from the pool instead of checked.
+  double sat_seconds;
+  double interpolation_seconds;
+  size_t definition_clauses;
+};
+
+struct sweep_options {
+  bool rewrite = false;
+  InterpolationSystem system = InterpolationSystem::PUDLAK;
+  bool compact_encoding = false;
+  // Only variables accepted here are checked (all if empty).
+  std::function<bool(int)> eligible;
+  // Called for every definition found, with its clauses and the first auxiliary variable they may use.
+  std::function<void(int variable, cnf& definition_clauses, int auxiliary_start)> on_definition;
+  // Called once per existential checked, i.e., per eligible existential until the sweep stops.
+  std::function<void()> on_progress;
+  // Called once per checked existential with its outcome.
+  std::function<void(const check_event&)> on_check;
+  const std::atomic<bool>* stop = nullptr; // Checked before every variable.
+  definition_pool* pool = nullptr;          // Shared with other sweeps, if any.
+  int target = 0;                           // Stop once this many definitions were found (0: no target).
+  // Number of definitions built in the background while the next checks run (0: build each one right away).
+  // Forward sweeps find the same definitions either way. The transitive sweep overlaps at most one definition and
+  // checks the next variable assuming it does not depend on that definition; if it turns out to, the check is repeated.
+  size_t pipeline_depth = 0;
+};
+
+struct sweep_statistics {
+  std::string strategy;
+  int nr_existential = 0;
+  int nr_defined = 0;
+  int nr_shared = 0; // Definitions adopted from the pool.
+  size_t total_definition_clauses = 0;
+  // Calls and times include checks that the transitive sweep repeats after discarding an overlapped definition.
+  size_t sat_calls = 0;
+  double sat_seconds = 0;
+  double interpolation_seconds = 0;
+  double total_seconds = 0;
+  bool stopped = false; // Interrupted before all variables were processed.
+};
+
+// Checks the existential variables of a QBF for definitions one after another, in the order given by a
+// variable_ordering, with supports restricted according to a SweepMode.
+class definition_sweeper {
+ public:
+  // The extractor must already contain the clauses.
+  definition_sweeper(definition_extractor& extractor, int num_variables, const std::vector<int>& variables, const std::vector<bool>& is_existential, const cnf& clauses);
+  sweep_statistics run(const variable_ordering& ordering, SweepMode mode, const sweep_options& options = {});
+
+  // Problem variables (excluding the defined variable) appearing in definition clauses.
+  static std::vector<int> definition_support(const cnf& definition_clauses, int variable, int num_variables);
+
+ private:
+  // A definition that has been found but not yet reported, in the order found.
+  struct pending_definition {
+    int variable;
+    std::optional<std::pair<cnf, int>> clauses; // Empty while queued in the extractor.
+    bool shared = false;
+    double sat_seconds = 0;
+    double interpolation_seconds = 0;
+  };
+
+  // earlier_sat_seconds and earlier_interpolation_seconds belong to a discarded check of y and are added to its event.
+  bool define_variable(int y, const std::vector<int>& defining_variables, const std::function<bool(int)>& allowed, const sweep_options& options, sweep_statistics& statistics,
+                       double earlier_sat_seconds = 0, double earlier_interpolation_seconds = 0);
+  std::pair<cnf, int> take_definition(pending_definition& pending, sweep_statistics& statistics);
+  std::vector<int> report_definition(const pending_definition& definition, cnf& definition_clauses, int aux_start, const sweep_options& options, sweep_statistics& statistics);
+  // Report pending definitions until at most keep remain, returns the variables reported with their supports.
+  std::vector<std::pair<int, std::vector<int>>> settle(size_t keep, const sweep_options& options, sweep_statistics& statistics);
+  void run_forward(const std::vector<size_t>& order, bool strict, const sweep_options& options, sweep_statistics& statistics);
+  void run_transitive(const std::vector<size_t>& order, const sweep_options& options, sweep_statistics& statistics);
+  bool should_stop(const sweep_options& options, const sweep_statistics& statistics) const;
+
+  definition_extractor& extractor;
+  int num_variables;
+  const std::vector<int>& variables;
+  const std::vector<bool>& is_existential;
+  const cnf& clauses;
+  std::deque<pending_definition> pending;
+};
+
+} // namespace definability_interpolation
+
+#endif /* DEFINITION_SWEEPER_HPP */
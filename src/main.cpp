@@ -8,6 +8,18 @@
 #include <algorithm>
 #include <cstdlib>
 #include <stdexcept>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <numeric>
+#include <map>
+#include <optional>
+#include <tuple>
+
+#include <unistd.h>
 
 #include "aig/aig/aig.h"
 #include "base/abc/abc.h"
@@ -16,7 +28,10 @@
 #include <CLI/CLI.hpp>
 
 #include "qdimacs.hpp"
-#include "definition_extractor.hpp"
+#include "components.hpp"
+#include "simplify.hpp"
+#include "definition_sweeper.hpp"
+#include "metrics.hpp"
 
 void displayProgress(double progress) {
   int barWidth = 70;
@@ -32,6 +47,47 @@ void displayProgress(double progress) {
   std::cout.flush();
 }
 
+// Thread-safe progress counter shared by all sweeps, counting checked existentials.
+// Only drawn on a terminal; use --events or --metrics-socket to follow runs elsewhere.
+class ProgressBar {
+ public:
+  explicit ProgressBar(size_t total) : total(std::max<size_t>(total, 1)), done(0), visible(isatty(STDOUT_FILENO)) {}
+
+  void advance() {
+    if (!visible) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    done++;
+    displayProgress(static_cast<double>(done) / static_cast<double>(total));
+  }
+
+ private:
+  size_t total;
+  size_t done;
+  bool visible;
+  std::mutex mutex;
+};
+
+using definability_interpolation::SweepMode;
+
+// Orderings selectable on the command line. Prefix order is reversed for the transitive sweep, which profits from
+// seeing inner variables first.
+std::unique_ptr<definability_interpolation::variable_ordering> makeOrdering(const std::string& name, SweepMode mode) {
+  if (name == "occurrence") {
+    return std::make_unique<definability_interpolation::occurrence_ordering>();
+  }
+  if (name == "dependency") {
+    return std::make_unique<definability_interpolation::dependency_ordering>();
+  }
+  return std::make_unique<definability_interpolation::prefix_ordering>(mode == SweepMode::TRANSITIVE);
+}
+
+void printStatistics(const definability_interpolation::sweep_statistics& statistics) {
+  std::cout << "SAT calls: " << statistics.sat_calls << " (" << std::setprecision(2) << std::fixed << statistics.sat_seconds
+            << "s), interpolation: " << statistics.interpolation_seconds << "s, total: " << statistics.total_seconds << "s" << std::endl;
+}
+
 int main(int argc, char** argv) {
   CLI::App app{"Find propositional definitions of existential variables"};
 
@@ -39,10 +95,10 @@ int main(int argc, char** argv) {
   app.add_option("input", filename, "QDIMACS input file")->required();
 
   bool basic = false;
-  app.add_flag("--basic", basic, "Use basic forward-order strategy");
+  auto basic_flag = app.add_flag("--basic", basic, "Use basic forward-order strategy");
 
   bool strict = false;
-  app.add_flag("--strict", strict, "With --basic: only add an existential to the support if it was defined (transitively) by the universal variables");
+  app.add_flag("--strict", strict, "With --basic: only add an existential to the support if it was defined (transitively) by the universal variables. With --portfolio: also run this strategy");
 
   std::string write_definitions_path;
   app.add_option("--write-definitions", write_definitions_path, "Write all definition clauses to a DIMACS file at the given path");
@@ -50,12 +106,69 @@ int main(int argc, char** argv) {
   std::string defined_variables_path;
   app.add_option("--defined-variables", defined_variables_path, "File listing variables known to be defined (single line, 0-terminated). Only these variables are checked for definability.");
 
+  std::string write_qdimacs_path;
+  app.add_option("--write-qdimacs", write_qdimacs_path, "Write a simplified QDIMACS file in which defined existentials are substituted or moved innermost together with their definitions");
+
+  bool decompose = false;
+  auto decompose_flag = app.add_flag("--decompose", decompose, "Split the matrix into components connected through existential variables and search each with its own extractor");
+
+  int jobs = 1;
+  app.add_option("--jobs", jobs, "With --decompose: number of components processed concurrently")->check(CLI::PositiveNumber);
+
+  bool portfolio = false;
+  auto portfolio_flag = app.add_flag("--portfolio", portfolio, "Run the forward and reverse strategies (and the strict forward strategy with --strict) concurrently, sharing definitions, and keep the first to finish");
+  portfolio_flag->excludes(basic_flag)->excludes(decompose_flag);
+
+  int portfolio_target = 0;
+  app.add_option("--portfolio-target", portfolio_target, "With --portfolio: stop as soon as one strategy has found this many definitions")->check(CLI::NonNegativeNumber);
+
+  definability_interpolation::sweep_options sweep_options;
+  std::map<std::string, definability_interpolation::InterpolationSystem> interpolation_systems{
+    {"pudlak", definability_interpolation::InterpolationSystem::PUDLAK},
+    {"mcmillan", definability_interpolation::InterpolationSystem::MCMILLAN},
+    {"mcmillan-dual", definability_interpolation::InterpolationSystem::MCMILLAN_DUAL},
+    {"smallest", definability_interpolation::InterpolationSystem::SMALLEST}
+  };
+  app.add_option("--interpolation", sweep_options.system, "Interpolation system used to build definitions (pudlak, mcmillan, mcmillan-dual, or smallest to try all and keep the smallest AIG)")
+    ->transform(CLI::CheckedTransformer(interpolation_systems, CLI::ignore_case));
+
+  app.add_flag("--compact-encoding", sweep_options.compact_encoding, "Encode definitions with n-ary AND, XOR and MUX gates and polarity-aware clauses instead of plain Tseitin");
+
+  std::string order = "prefix";
+  app.add_option("--order", order, "Order in which existentials are checked: prefix (reversed unless --basic), occurrence (fewest occurrences first) or dependency (closest to the universals first)")
+    ->check(CLI::IsMember({"prefix", "occurrence", "dependency"}));
+
+  app.add_option("--pipeline-depth", sweep_options.pipeline_depth, "Build up to this many definitions in the background while the next variables are checked (the default sweep overlaps at most one)");
+
+  size_t proofnode_threads = 1;
+  app.add_option("--proofnode-threads", proofnode_threads, "Threads building the proof DAG of each refutation, resolving clauses at the same depth concurrently")->check(CLI::PositiveNumber);
+
+  std::string events_path;
+  auto events_option = app.add_option("--events", events_path, "Write one JSON line per checked existential (result, SAT and interpolation time, definition size, RSS) to this file");
+  int events_fd = -1;
+  app.add_option("--events-fd", events_fd, "Write the JSON lines of --events to this open file descriptor instead")
+    ->check(CLI::NonNegativeNumber)->excludes(events_option);
+
+  std::string metrics_socket_path;
+  app.add_option("--metrics-socket", metrics_socket_path, "Serve the current counters as JSON on a Unix socket at this path (plain or HTTP, e.g. curl --unix-socket)");
+
   CLI11_PARSE(app, argc, argv);
 
   bool write_definitions = !write_definitions_path.empty();
+  bool write_qdimacs = !write_qdimacs_path.empty();
   bool restrict_to_defined = !defined_variables_path.empty();
 
   try {
+    Metrics metrics;
+    if (!events_path.empty()) {
+      metrics.open_events(events_path);
+    } else if (events_fd >= 0) {
+      metrics.use_events_fd(events_fd);
+    }
+    if (!metrics_socket_path.empty()) {
+      metrics.serve(metrics_socket_path);
+    }
+
     auto [num_variables, variables, is_existential, clauses] = parseQDIMACS(filename);
 
     std::unordered_set<int> defined_variables_set;
@@ -73,131 +186,222 @@ int main(int argc, char** argv) {
       }
     }
 
-    definability_interpolation::definition_extractor extractor;
-    extractor.append_formula(clauses);
-    int nr_defined = 0;
-    int nr_existential = 0;
-    std::vector<std::vector<int>> all_definition_clauses;
-
-    size_t total_definition_clauses = 0;
-
-    if (basic) {
-      // Original forward-order strategy: iterate variables in QDIMACS order,
-      // accumulating defining variables as we go.
-      std::vector<int> defining_variables;
-      for (int i = 0; i < variables.size(); i++) {
-        displayProgress(static_cast<double>(i + 1) / static_cast<double>(num_variables));
-        auto v = variables[i];
-        bool defined = false;
-        if (is_existential[i]) {
-          nr_existential++;
-          bool eligible = !restrict_to_defined || defined_variables_set.count(v);
-          if (eligible && extractor.has_definition(v, defining_variables, {})) {
-            nr_defined++;
-            defined = true;
-            auto [def_clauses, aux_start] = extractor.get_definition(false);
-            total_definition_clauses += def_clauses.size();
-            if (write_definitions) {
-              all_definition_clauses.insert(all_definition_clauses.end(),
-                std::make_move_iterator(def_clauses.begin()),
-                std::make_move_iterator(def_clauses.end()));
-            }
+    definability_interpolation::sweep_statistics total;
+    std::vector<Definition> definitions;
+
+    auto collect_definition = [&](int variable, definability_interpolation::cnf& definition_clauses, std::vector<Definition>& destination) {
+      if (write_definitions || write_qdimacs) {
+        destination.push_back({variable, std::move(definition_clauses)});
+      }
+    };
+
+    auto eligible = [&](int v) { return !restrict_to_defined || defined_variables_set.count(v); };
+    sweep_options.eligible = eligible;
+    // Existentials a sweep over this prefix checks, the progress denominator.
+    auto nr_checked = [&](const std::vector<int>& prefix, const std::vector<bool>& existential, const std::function<int(int)>& global) {
+      size_t count = 0;
+      for (size_t i = 0; i < prefix.size(); i++) {
+        count += existential[i] && eligible(global(prefix[i]));
+      }
+      return count;
+    };
+    auto identity = [](int v) { return v; };
+    auto mode = !basic ? SweepMode::TRANSITIVE : strict ? SweepMode::FORWARD_STRICT : SweepMode::FORWARD;
+
+    if (portfolio) {
+      struct Member {
+        std::string name;
+        SweepMode mode;
+      };
+      std::vector<Member> members = {{"forward", SweepMode::FORWARD}, {"reverse", SweepMode::TRANSITIVE}};
+      if (strict) {
+        members.push_back({"forward-strict", SweepMode::FORWARD_STRICT});
+      }
+      ProgressBar progress(nr_checked(variables, is_existential, identity) * members.size());
+      std::atomic<bool> stop{false};
+      std::atomic<int> winner{-1};
+      definability_interpolation::definition_pool pool;
+      std::vector<definability_interpolation::sweep_statistics> results(members.size());
+      std::vector<std::vector<Definition>> member_definitions(members.size());
+      std::exception_ptr error;
+      std::mutex error_mutex;
+
+      auto run_member = [&](size_t m) {
+        try {
+          definability_interpolation::definition_extractor extractor;
+          extractor.set_proofnode_threads(proofnode_threads);
+          extractor.append_formula(clauses, num_variables);
+          auto options = sweep_options;
+          options.on_definition = [&](int variable, definability_interpolation::cnf& definition_clauses, int) {
+            collect_definition(variable, definition_clauses, member_definitions[m]);
+          };
+          options.on_progress = [&progress]() { progress.advance(); };
+          if (metrics.active()) {
+            options.on_check = [&](const definability_interpolation::check_event& event) { metrics.record(event, members[m].name); };
           }
+          options.stop = &stop;
+          options.pool = &pool;
+          options.target = portfolio_target;
+          definability_interpolation::definition_sweeper sweeper(extractor, num_variables, variables, is_existential, clauses);
+          results[m] = sweeper.run(*makeOrdering(order, members[m].mode), members[m].mode, options);
+          bool reached_target = portfolio_target > 0 && results[m].nr_defined >= portfolio_target;
+          int expected = -1;
+          if ((!results[m].stopped || reached_target) && winner.compare_exchange_strong(expected, m)) {
+            stop = true;
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error) error = std::current_exception();
+          stop = true;
         }
-        if (!is_existential[i] || !strict || defined) {
-          defining_variables.push_back(v);
+      };
+      std::vector<std::thread> threads;
+      for (size_t m = 1; m < members.size(); m++) {
+        threads.emplace_back(run_member, m);
+      }
+      run_member(0);
+      for (auto& thread: threads) {
+        thread.join();
+      }
+      if (winner < 0) {
+        if (error) {
+          std::rethrow_exception(error);
         }
+        throw std::runtime_error("no portfolio strategy finished");
+      }
+      total = results[winner];
+      definitions = std::move(member_definitions[winner]);
+      std::cout << std::endl;
+      for (size_t m = 0; m < members.size(); m++) {
+        std::cout << "Strategy " << members[m].name << ": " << results[m].nr_defined << " defined ("
+                  << results[m].nr_shared << " shared)" << (results[m].stopped && static_cast<int>(m) != winner ? ", stopped" : "") << ", ";
+        printStatistics(results[m]);
       }
+      std::cout << "Portfolio winner: " << members[winner].name;
+    } else if (!decompose) {
+      definability_interpolation::definition_extractor extractor;
+      extractor.set_proofnode_threads(proofnode_threads);
+      extractor.append_formula(clauses, num_variables);
+      ProgressBar progress(nr_checked(variables, is_existential, identity));
+      sweep_options.on_definition = [&](int variable, definability_interpolation::cnf& definition_clauses, int) {
+        collect_definition(variable, definition_clauses, definitions);
+      };
+      sweep_options.on_progress = [&progress]() { progress.advance(); };
+      if (metrics.active()) {
+        sweep_options.on_check = [&metrics](const definability_interpolation::check_event& event) { metrics.record(event); };
+      }
+      definability_interpolation::definition_sweeper sweeper(extractor, num_variables, variables, is_existential, clauses);
+      total = sweeper.run(*makeOrdering(order, mode), mode, sweep_options);
     } else {
-      // Reverse-order strategy with transitive support checking.
-      std::unordered_set<int> universal_vars;
-      std::unordered_set<int> existential_vars;
-      for (int i = 0; i < variables.size(); i++) {
-        if (is_existential[i]) existential_vars.insert(variables[i]);
-        else universal_vars.insert(variables[i]);
-      }
-
-      // reverse_support[z] = vars whose direct support contains z.
-      std::unordered_map<int, std::vector<int>> reverse_support;
-      int num_variables_int = static_cast<int>(num_variables);
-
-      for (int i = variables.size() - 1; i >= 0; i--) {
-        displayProgress(static_cast<double>(variables.size() - i) / static_cast<double>(num_variables));
-        auto y = variables[i];
-        if (!is_existential[i]) continue;
-
-        nr_existential++;
-
-        if (restrict_to_defined && !defined_variables_set.count(y)) continue;
-
-        // BFS from y through reverse_support to find all vars that transitively depend on y.
-        std::unordered_set<int> depends_on_y;
-        auto rev_it = reverse_support.find(y);
-        if (rev_it != reverse_support.end()) {
-          std::vector<int> queue(rev_it->second.begin(), rev_it->second.end());
-          depends_on_y.insert(queue.begin(), queue.end());
-          size_t idx = 0;
-          while (idx < queue.size()) {
-            int x = queue[idx++];
-            auto it = reverse_support.find(x);
-            if (it == reverse_support.end()) continue;
-            for (int w : it->second) {
-              if (depends_on_y.insert(w).second) {
-                queue.push_back(w);
-              }
-            }
-          }
-        }
+      auto components = decomposeComponents(num_variables, variables, is_existential, clauses);
+      if (!write_qdimacs) {
+        clauses.clear();
+        clauses.shrink_to_fit();
+      }
 
-        std::vector<int> defining_variables;
-        for (auto u : universal_vars) {
-          defining_variables.push_back(u);
-        }
-        for (auto e : existential_vars) {
-          if (e == y) continue;
-          if (depends_on_y.count(e)) continue;
-          defining_variables.push_back(e);
+      // Auxiliary variables of component definitions are moved above all problem variables.
+      int max_variable = num_variables;
+      size_t progress_total = 0;
+      for (const auto& component: components) {
+        for (auto v: component.local_to_global) {
+          max_variable = std::max(max_variable, v);
         }
+        progress_total += nr_checked(component.variables, component.is_existential, [&component](int v) { return component.global_literal(v); });
+      }
+      int auxiliary_base = 3 * (max_variable + 1);
+      ProgressBar progress(progress_total);
 
-        if (extractor.has_definition(y, defining_variables, {})) {
-          nr_defined++;
-          auto [definition_clauses, aux_start] = extractor.get_definition(false);
-          total_definition_clauses += definition_clauses.size();
-
-          // Compute direct support: problem variables (excluding y) appearing in the definition clauses.
-          std::vector<int> support;
-          for (const auto& clause : definition_clauses) {
-            for (int lit : clause) {
-              int var = abs(lit);
-              if (var != y && var <= num_variables_int) {
-                support.push_back(var);
+      // Process large components first for better load balance, but merge results in component order.
+      std::vector<size_t> schedule(components.size());
+      std::iota(schedule.begin(), schedule.end(), 0);
+      std::stable_sort(schedule.begin(), schedule.end(), [&](size_t a, size_t b) {
+        return components[a].clauses.size() > components[b].clauses.size();
+      });
+      std::vector<definability_interpolation::sweep_statistics> results(components.size());
+      std::vector<std::vector<Definition>> component_definitions(components.size());
+      std::atomic<size_t> next_component{0};
+      std::exception_ptr error;
+      std::mutex error_mutex;
+
+      auto worker = [&]() {
+        size_t k;
+        while ((k = next_component++) < schedule.size()) {
+          auto c = schedule[k];
+          try {
+            auto& component = components[c];
+            auto extractor = std::make_unique<definability_interpolation::definition_extractor>();
+            extractor->set_proofnode_threads(proofnode_threads);
+            extractor->append_formula(component.clauses, component.num_variables());
+            auto options = sweep_options;
+            options.eligible = [&](int v) { return eligible(component.global_literal(v)); };
+            options.on_definition = [&](int variable, definability_interpolation::cnf& definition_clauses, int aux_start) {
+              for (auto& l: definition_clauses.all_literals()) {
+                auto v = std::abs(l);
+                if (v <= component.num_variables()) {
+                  l = component.global_literal(l);
+                } else {
+                  auto global_v = v - aux_start + auxiliary_base;
+                  l = l < 0 ? -global_v : global_v;
+                }
               }
+              collect_definition(component.global_literal(variable), definition_clauses, component_definitions[c]);
+            };
+            options.on_progress = [&progress]() { progress.advance(); };
+            if (metrics.active()) {
+              options.on_check = [&, c](definability_interpolation::check_event event) {
+                event.variable = component.global_literal(event.variable);
+                metrics.record(event, "", c);
+              };
             }
-          }
-          std::sort(support.begin(), support.end());
-          support.erase(std::unique(support.begin(), support.end()), support.end());
-
-          for (int z : support) {
-            reverse_support[z].push_back(y);
-          }
-
-          if (write_definitions) {
-            all_definition_clauses.insert(all_definition_clauses.end(),
-              std::make_move_iterator(definition_clauses.begin()),
-              std::make_move_iterator(definition_clauses.end()));
+            definability_interpolation::definition_sweeper sweeper(*extractor, component.num_variables(), component.variables, component.is_existential, component.clauses);
+            results[c] = sweeper.run(*makeOrdering(order, mode), mode, options);
+            component.clauses = {};
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = std::current_exception();
           }
         }
+      };
+      std::vector<std::thread> threads;
+      for (int t = 1; t < std::min<int>(jobs, components.size()); t++) {
+        threads.emplace_back(worker);
+      }
+      worker();
+      for (auto& thread: threads) {
+        thread.join();
       }
+      if (error) {
+        std::rethrow_exception(error);
+      }
+
+      for (size_t c = 0; c < components.size(); c++) {
+        total.nr_defined += results[c].nr_defined;
+        total.nr_existential += results[c].nr_existential;
+        total.total_definition_clauses += results[c].total_definition_clauses;
+        total.sat_calls += results[c].sat_calls;
+        total.sat_seconds += results[c].sat_seconds;
+        total.interpolation_seconds += results[c].interpolation_seconds;
+        total.total_seconds += results[c].total_seconds;
+        definitions.insert(definitions.end(),
+          std::make_move_iterator(component_definitions[c].begin()),
+          std::make_move_iterator(component_definitions[c].end()));
+      }
+      std::cout << std::endl << "Number of components: " << components.size();
     }
 
     std::cout << std::endl;
-    std::cout << "Number of defined existential variables: " << nr_defined << "/" << nr_existential << std::endl;
-    std::cout << "Total number of definition clauses: " << total_definition_clauses << std::endl;
+    std::cout << "Number of defined existential variables: " << total.nr_defined << "/" << total.nr_existential << std::endl;
+    std::cout << "Total number of definition clauses: " << total.total_definition_clauses << std::endl;
+    if (!portfolio) {
+      printStatistics(total);
+    }
 
     if (write_definitions) {
       int max_var = 0;
-      for (const auto& cl : all_definition_clauses) {
-        for (int lit : cl) {
+      size_t nr_clauses = 0;
+      for (const auto& definition : definitions) {
+        nr_clauses += definition.clauses.size();
+        for (int lit : definition.clauses.all_literals()) {
           int v = std::abs(lit);
           if (v > max_var) max_var = v;
         }
@@ -207,10 +411,22 @@ int main(int argc, char** argv) {
         std::cerr << "Error: could not open " << write_definitions_path << " for writing" << std::endl;
         return 1;
       }
-      out << "p cnf " << max_var << " " << all_definition_clauses.size() << "\n";
-      for (const auto& cl : all_definition_clauses) {
-        for (int lit : cl) out << lit << " ";
-        out << "0\n";
+      out << "p cnf " << max_var << " " << nr_clauses << "\n";
+      for (const auto& definition : definitions) {
+        for (auto cl : definition.clauses) {
+          for (int lit : cl) out << lit << " ";
+          out << "0\n";
+        }
+      }
+    }
+
+    if (write_qdimacs) {
+      auto simplified = eliminateDefinitions(num_variables, variables, is_existential, clauses, std::move(definitions));
+      std::cout << "Substituted variables: " << simplified.nr_substituted << ", moved innermost: " << simplified.nr_moved
+                << ", redundant clauses removed: " << simplified.nr_redundant_clauses << std::endl;
+      if (!writeQDIMACS(write_qdimacs_path, simplified.num_variables, simplified.variables, simplified.is_existential, simplified.clauses)) {
+        std::cerr << "Error: could not open " << write_qdimacs_path << " for writing" << std::endl;
+        return 1;
       }
     }
   }
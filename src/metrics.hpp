@@ -0,0 +1,246 @@
+#ifndef METRICS_HPP_
+#define METRICS_HPP_
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "definition_sweeper.hpp"
+
+// Resident set size of this process in bytes, 0 if /proc/self/statm cannot be read.
+inline size_t residentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t pages, resident;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Counters of a running search, shared by all sweeps. Every checked variable can be written as a JSON line to a file
+// or file descriptor, and the current counters can be served as a JSON object on a Unix socket (plain, or as an HTTP
+// response if the client sends a GET request, e.g. curl --unix-socket).
+class Metrics {
+ public:
+  Metrics() : start(std::chrono::steady_clock::now()), last_event(start) {}
+  ~Metrics() {
+    if (server.joinable()) {
+      server_stop = true;
+      server.join();
+      close(server_fd);
+      unlink(socket_path.c_str());
+    }
+    if (owns_event_fd) {
+      close(event_fd);
+    }
+  }
+
+  bool active() const { return event_fd >= 0 || server.joinable(); }
+
+  void open_events(const std::string& path) {
+    event_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (event_fd < 0) {
+      throw std::runtime_error("could not open " + path + " for writing: " + std::strerror(errno));
+    }
+    owns_event_fd = true;
+    ignore_broken_pipes();
+  }
+
+  // The descriptor stays open after the run.
+  void use_events_fd(int fd) {
+    event_fd = fd;
+    owns_event_fd = false;
+    ignore_broken_pipes();
+  }
+
+  void serve(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+      throw std::runtime_error("socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+      throw std::runtime_error(std::string("could not create a socket: ") + std::strerror(errno));
+    }
+    // Only a socket left behind by an earlier run is replaced.
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0) {
+      if (!S_ISSOCK(existing.st_mode)) {
+        close(server_fd);
+        throw std::runtime_error(path + " exists and is not a socket");
+      }
+      unlink(path.c_str());
+    }
+    if (bind(server_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(server_fd, 4) < 0) {
+      auto error = std::string(std::strerror(errno));
+      close(server_fd);
+      throw std::runtime_error("could not listen on " + path + ": " + error);
+    }
+    socket_path = path;
+    server = std::thread(&Metrics::serve_loop, this);
+  }
+
+  // Strategy and component are only written if given.
+  // Reading the RSS and writing the line happen outside the counter lock, so a slow reader of the event stream
+  // only holds up other writers of the stream, not sweeps that merely count or the socket server.
+  void record(const definability_interpolation::check_event& event, const std::string& strategy = "", int component = -1) {
+    bool write_event = event_fd >= 0 && !events_failed.load(std::memory_order_relaxed);
+    auto rss = write_event ? residentBytes() : 0;
+    std::ostringstream line;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      last_event = std::chrono::steady_clock::now();
+      checked++;
+      if (event.defined) {
+        defined++;
+        shared += event.shared;
+        definition_clauses += event.definition_clauses;
+      }
+      sat_seconds += event.sat_seconds;
+      interpolation_seconds += event.interpolation_seconds;
+      if (!write_event) {
+        return;
+      }
+      line << std::fixed << std::setprecision(6) << "{\"time\":" << seconds(last_event);
+    }
+    if (!strategy.empty()) {
+      line << ",\"strategy\":\"" << strategy << "\"";
+    }
+    if (component >= 0) {
+      line << ",\"component\":" << component;
+    }
+    line << ",\"variable\":" << event.variable
+         << ",\"result\":\"" << (!event.defined ? "undefined" : event.shared ? "shared" : "defined") << "\""
+         << ",\"sat_seconds\":" << event.sat_seconds
+         << ",\"interpolation_seconds\":" << event.interpolation_seconds
+         << ",\"definition_clauses\":" << event.definition_clauses
+         << ",\"rss_bytes\":" << rss << "}\n";
+    std::lock_guard<std::mutex> lock(write_mutex);
+    if (events_failed) {
+      return;
+    }
+    if (!write_all(event_fd, line.str())) {
+      // E.g. the reader of a pipe exited: keep searching without the stream.
+      std::cerr << "Warning: could not write to the event stream (" << std::strerror(errno) << "), no further events are written" << std::endl;
+      events_failed = true;
+    }
+  }
+
+  std::string counters() {
+    auto rss = residentBytes();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(6) << "{\"time\":" << seconds(now)
+         << ",\"seconds_since_last_check\":" << std::chrono::duration<double>(now - last_event).count()
+         << ",\"checked\":" << checked
+         << ",\"defined\":" << defined
+         << ",\"shared\":" << shared
+         << ",\"definition_clauses\":" << definition_clauses
+         << ",\"sat_seconds\":" << sat_seconds
+         << ",\"interpolation_seconds\":" << interpolation_seconds
+         << ",\"rss_bytes\":" << rss << "}\n";
+    return json.str();
+  }
+
+ private:
+  double seconds(std::chrono::steady_clock::time_point time) const {
+    return std::chrono::duration<double>(time - start).count();
+  }
+
+  // Writes to a closed pipe fail with EPIPE instead of terminating the run.
+  static void ignore_broken_pipes() {
+    std::signal(SIGPIPE, SIG_IGN);
+  }
+
+  static bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+      auto n = write(fd, data.data() + written, data.size() - written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      written += n;
+    }
+    return true;
+  }
+
+  // Polls so that the destructor can stop the loop without waking a blocked accept.
+  void serve_loop() {
+    while (!server_stop) {
+      pollfd listener{server_fd, POLLIN, 0};
+      if (poll(&listener, 1, 200) <= 0) {
+        continue;
+      }
+      int client = accept(server_fd, nullptr, nullptr);
+      if (client < 0) {
+        continue;
+      }
+      // Give the client a moment to send a request, but also answer clients that only read.
+      char request[1024];
+      ssize_t received = 0;
+      pollfd readable{client, POLLIN, 0};
+      if (poll(&readable, 1, 50) > 0) {
+        received = recv(client, request, sizeof(request), 0);
+      }
+      auto body = counters();
+      std::string response = body;
+      if (received >= 4 && std::strncmp(request, "GET ", 4) == 0) {
+        response = "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+      }
+      size_t sent = 0;
+      while (sent < response.size()) {
+        auto n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+          break;
+        }
+        sent += n;
+      }
+      close(client);
+    }
+  }
+
+  std::chrono::steady_clock::time_point start;
+  std::mutex mutex;
+  std::chrono::steady_clock::time_point last_event;
+  size_t checked = 0;
+  size_t defined = 0;
+  size_t shared = 0;
+  size_t definition_clauses = 0;
+  double sat_seconds = 0;
+  double interpolation_seconds = 0;
+
+  int event_fd = -1;
+  bool owns_event_fd = false;
+  std::mutex write_mutex;
+  std::atomic<bool> events_failed{false};
+
+  int server_fd = -1;
+  std::string socket_path;
+  std::thread server;
+  std::atomic<bool> server_stop{false};
+};
+
+#endif // METRICS_HPP_
@@ -8,6 +8,8 @@
 #include <exception>
 #include <tuple>
 
+#include "cnf.hpp"
+
 class FileDoesNotExistException: public std::exception {
  public:
   FileDoesNotExistException(const std::string& filename)
@@ -30,7 +32,7 @@ auto parseQDIMACS(const std::string& filename) {
   int num_variables, num_clauses;
   std::vector<int> variables;
   std::vector<bool> is_existential;
-  std::vector<std::vector<int>> clauses;
+  definability_interpolation::cnf clauses;
 
   while (std::getline(file, line)) {
     if (line.empty())
@@ -40,8 +42,10 @@ auto parseQDIMACS(const std::string& filename) {
     iss >> ch;
     if (ch == 'c') // Comment line
       continue;
-    else if (ch == 'p') // Header line
+    else if (ch == 'p') { // Header line
       iss >> buffer >> num_variables >> num_clauses;
+      clauses.reserve(num_clauses, 0);
+    }
     else if (ch == 'a' || ch == 'e') { // Quantifier line
       bool existential = (ch == 'e');
       int variable;
@@ -52,14 +56,37 @@ auto parseQDIMACS(const std::string& filename) {
     }
     else {// Clause line
       iss.putback(ch);
-      std::vector<int> clause;
       int literal;
       while(iss >> literal, literal != 0)
-        clause.push_back(literal);
-      clauses.push_back(clause);
+        clauses.push_literal(literal);
+      clauses.end_clause();
     }
   }
   return std::make_tuple(num_variables, variables, is_existential, clauses);
 }
 
+// Write a QBF in QDIMACS format, grouping consecutive variables with the same quantifier into one block.
+inline bool writeQDIMACS(const std::string& filename, int num_variables, const std::vector<int>& variables, const std::vector<bool>& is_existential, const definability_interpolation::cnf& clauses) {
+  std::ofstream out(filename);
+  if (!out)
+    return false;
+  out << "p cnf " << num_variables << " " << clauses.size() << "\n";
+  for (size_t i = 0; i < variables.size(); i++) {
+    if (i == 0 || is_existential[i] != is_existential[i - 1]) {
+      if (i > 0)
+        out << " 0\n";
+      out << (is_existential[i] ? 'e' : 'a');
+    }
+    out << " " << variables[i];
+  }
+  if (!variables.empty())
+    out << " 0\n";
+  for (auto clause: clauses) {
+    for (auto l: clause)
+      out << l << " ";
+    out << "0\n";
+  }
+  return true;
+}
+
 #endif // QDIMACS_HPP_
\ No newline at end of file
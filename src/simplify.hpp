@@ -0,0 +1,294 @@
+#ifndef SIMPLIFY_HPP_
+#define SIMPLIFY_HPP_
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+#include "cnf.hpp"
+
+// Definition clauses of a single variable, over problem variables and auxiliary variables above them.
+struct Definition {
+  int variable;
+  definability_interpolation::cnf clauses;
+};
+
+struct SimplifiedQBF {
+  int num_variables = 0;
+  std::vector<int> variables;
+  std::vector<bool> is_existential;
+  definability_interpolation::cnf clauses;
+  int nr_substituted = 0;
+  int nr_moved = 0;
+  int nr_redundant_clauses = 0;
+};
+
+namespace simplify_detail {
+
+constexpr int literal_true = std::numeric_limits<int>::max();
+constexpr int literal_false = -literal_true;
+
+// If the definition forces the defined variable to be equivalent to a problem literal or a constant
+// through binary equivalences and units, return that literal (or literal_true/literal_false), else 0.
+inline int equivalent_literal(const Definition& definition, int max_problem_variable) {
+  std::unordered_map<int, std::vector<int>> implications;
+  std::unordered_set<int> units;
+  for (auto clause: definition.clauses) {
+    if (clause.size() == 1) {
+      units.insert(clause[0]);
+    } else if (clause.size() == 2) {
+      implications[-clause[0]].push_back(clause[1]);
+      implications[-clause[1]].push_back(clause[0]);
+    }
+  }
+  auto implies = [&implications](int a, int b) {
+    auto it = implications.find(a);
+    return it != implications.end() && std::find(it->second.begin(), it->second.end(), b) != it->second.end();
+  };
+  // Walk equivalences a <-> b, i.e., pairs of binary clauses (-a, b) and (a, -b).
+  std::vector<int> queue = {definition.variable};
+  std::unordered_set<int> seen = {definition.variable};
+  for (size_t i = 0; i < queue.size(); i++) {
+    auto a = queue[i];
+    if (units.contains(a)) {
+      return literal_true;
+    }
+    if (units.contains(-a)) {
+      return literal_false;
+    }
+    if (std::abs(a) != definition.variable && std::abs(a) <= max_problem_variable) {
+      return a;
+    }
+    auto it = implications.find(a);
+    if (it == implications.end()) {
+      continue;
+    }
+    for (auto b: it->second) {
+      if (!seen.contains(b) && implies(b, a)) {
+        seen.insert(b);
+        queue.push_back(b);
+      }
+    }
+  }
+  return 0;
+}
+
+// Unit propagation over the given clauses starting from the assumptions, returns true on conflict.
+inline bool propagates_to_conflict(const definability_interpolation::cnf& clauses, const std::unordered_map<int, std::vector<size_t>>& occurrences, const std::vector<int>& assumptions) {
+  std::unordered_set<int> assigned;
+  std::vector<int> trail;
+  for (auto l: assumptions) {
+    if (assigned.contains(-l)) {
+      return true;
+    }
+    if (assigned.insert(l).second) {
+      trail.push_back(l);
+    }
+  }
+  for (size_t i = 0; i < trail.size(); i++) {
+    auto it = occurrences.find(-trail[i]);
+    if (it == occurrences.end()) {
+      continue;
+    }
+    for (auto c: it->second) {
+      int unassigned = 0;
+      int unit = 0;
+      bool satisfied = false;
+      for (auto l: clauses[c]) {
+        if (assigned.contains(l)) {
+          satisfied = true;
+          break;
+        }
+        if (!assigned.contains(-l)) {
+          unassigned++;
+          unit = l;
+        }
+      }
+      if (satisfied) {
+        continue;
+      }
+      if (unassigned == 0) {
+        return true;
+      }
+      if (unassigned == 1) {
+        assigned.insert(unit);
+        trail.push_back(unit);
+      }
+    }
+  }
+  return false;
+}
+
+} // namespace simplify_detail
+
+// Use definitions to simplify a QBF. A defined existential y is only touched if every variable in the support of
+// its definition precedes y in the prefix; then y may be treated as a function of variables already assigned.
+// - If the definition makes y equivalent to a literal or a constant, y is substituted and dropped from the prefix.
+// - Otherwise y moves to the innermost existential block and its definition is conjoined, with fresh auxiliary
+//   variables that are quantified innermost. Clauses containing y that unit propagation derives from the
+//   definition alone are removed.
+inline SimplifiedQBF eliminateDefinitions(int num_variables, const std::vector<int>& variables, const std::vector<bool>& is_existential, const definability_interpolation::cnf& clauses, std::vector<Definition> definitions) {
+  using namespace simplify_detail;
+  int max_variable = num_variables;
+  for (auto v: variables) {
+    max_variable = std::max(max_variable, v);
+  }
+  for (auto l: clauses.all_literals()) {
+    max_variable = std::max(max_variable, std::abs(l));
+  }
+  // Free variables are outermost.
+  std::vector<int> position(max_variable + 1, -1);
+  std::vector<bool> existential(max_variable + 1, true);
+  for (size_t i = 0; i < variables.size(); i++) {
+    position[variables[i]] = i;
+    existential[variables[i]] = is_existential[i];
+  }
+
+  SimplifiedQBF result;
+  std::unordered_map<int, int> substitution;
+  std::vector<Definition> moved;
+  for (auto& definition: definitions) {
+    auto y = definition.variable;
+    if (y > max_variable || position[y] < 0 || !existential[y]) {
+      continue;
+    }
+    bool eligible = true;
+    for (auto l: definition.clauses.all_literals()) {
+      auto v = std::abs(l);
+      if (v != y && v <= max_variable && position[v] >= position[y]) {
+        eligible = false;
+      }
+    }
+    if (!eligible) {
+      continue;
+    }
+    auto literal = equivalent_literal(definition, max_variable);
+    if (literal != 0) {
+      substitution[y] = literal;
+      result.nr_substituted++;
+    } else {
+      moved.push_back(std::move(definition));
+      result.nr_moved++;
+    }
+  }
+
+  // Substitutions only refer to earlier variables, so following them terminates.
+  auto resolve = [&substitution](int literal) {
+    while (literal != literal_true && literal != literal_false) {
+      auto it = substitution.find(std::abs(literal));
+      if (it == substitution.end()) {
+        break;
+      }
+      literal = literal < 0 ? -it->second : it->second;
+    }
+    return literal;
+  };
+  // Apply substitutions, returns false if the clause became satisfied.
+  std::vector<int> substituted;
+  auto substitute = [&resolve, &substituted](std::vector<int>& clause) {
+    substituted.clear();
+    for (auto l: clause) {
+      auto s = resolve(l);
+      if (s == literal_true) {
+        return false;
+      }
+      if (s == literal_false) {
+        continue;
+      }
+      substituted.push_back(s);
+    }
+    std::sort(substituted.begin(), substituted.end());
+    substituted.erase(std::unique(substituted.begin(), substituted.end()), substituted.end());
+    for (size_t i = 0; i + 1 < substituted.size(); i++) {
+      if (std::binary_search(substituted.begin() + i + 1, substituted.end(), -substituted[i])) {
+        return false;
+      }
+    }
+    clause.swap(substituted);
+    return true;
+  };
+
+  // Conjoin the definitions of moved variables, renaming auxiliary variables apart.
+  std::vector<int> innermost;
+  std::unordered_map<int, size_t> moved_index;
+  std::vector<definability_interpolation::cnf> moved_clauses(moved.size());
+  std::vector<std::unordered_map<int, std::vector<size_t>>> moved_occurrences(moved.size());
+  int next_variable = max_variable + 1;
+  std::vector<int> clause;
+  for (size_t d = 0; d < moved.size(); d++) {
+    moved_index[moved[d].variable] = d;
+    innermost.push_back(moved[d].variable);
+    std::unordered_map<int, int> auxiliary_renaming;
+    for (auto definition_clause: moved[d].clauses) {
+      clause.assign(definition_clause.begin(), definition_clause.end());
+      for (auto& l: clause) {
+        auto v = std::abs(l);
+        if (v > max_variable) {
+          auto [it, inserted] = auxiliary_renaming.emplace(v, next_variable);
+          if (inserted) {
+            innermost.push_back(next_variable++);
+          }
+          l = l < 0 ? -it->second : it->second;
+        }
+      }
+      if (substitute(clause)) {
+        for (auto l: clause) {
+          moved_occurrences[d][l].push_back(moved_clauses[d].size());
+        }
+        moved_clauses[d].add_clause(clause);
+      }
+    }
+  }
+
+  for (auto original: clauses) {
+    clause.assign(original.begin(), original.end());
+    if (!substitute(clause)) {
+      continue;
+    }
+    // Drop the clause if the definition of a moved variable in it already implies it.
+    bool redundant = false;
+    for (auto l: clause) {
+      auto it = moved_index.find(std::abs(l));
+      if (it == moved_index.end()) {
+        continue;
+      }
+      std::vector<int> negation;
+      for (auto k: clause) {
+        negation.push_back(-k);
+      }
+      if (propagates_to_conflict(moved_clauses[it->second], moved_occurrences[it->second], negation)) {
+        redundant = true;
+        break;
+      }
+    }
+    if (redundant) {
+      result.nr_redundant_clauses++;
+      continue;
+    }
+    result.clauses.add_clause(clause);
+  }
+  for (const auto& definition_clauses: moved_clauses) {
+    result.clauses.append(definition_clauses);
+  }
+
+  // Rebuild the prefix without substituted variables and with moved ones at the end.
+  for (size_t i = 0; i < variables.size(); i++) {
+    auto v = variables[i];
+    if (substitution.contains(v) || moved_index.contains(v)) {
+      continue;
+    }
+    result.variables.push_back(v);
+    result.is_existential.push_back(is_existential[i]);
+  }
+  for (auto v: innermost) {
+    result.variables.push_back(v);
+    result.is_existential.push_back(true);
+  }
+  result.num_variables = next_variable - 1;
+  return result;
+}
+
+#endif // SIMPLIFY_HPP_